@@ -4,8 +4,34 @@
 #include <tuple>
 #include <type_traits>
 #include <cmath>
+#include <complex>
+#include <limits>
 #include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <immintrin.h>
+
+#if defined(ARRR_DISPATCH)
+// the evaluators pass vectors between functions that are compiled without
+// the matching target, but dispatch.hpp flattens all of them into the
+// per instruction set loops so no call with the changed ABI remains. The
+// warning is reported at the end of the translation unit, so it stays off.
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
 
 namespace arrr {
     // constify is a workaround for g++ not allowing template dependent
@@ -20,6 +46,14 @@ namespace arrr {
     #define ARRR_ALIGN(alignment) alignas(constify(alignment))
 #endif
 
+    // ARRR_INLINE forces the loop helpers that stitch the unrolled roots
+    // together into the loop, otherwise the roots end up in memory.
+#if defined(__GNUC__)
+    #define ARRR_INLINE inline __attribute__((always_inline))
+#else
+    #define ARRR_INLINE inline
+#endif
+
     template<typename T>
     struct is_node {
         static const bool value = false;
@@ -33,6 +67,16 @@ namespace arrr {
         >::type type;
     };
 
+    // promoted_binary<tag, T1, T2>::type is the node of a binary operation.
+    // Operands of different element types are cast to a common one, see
+    // cast.hpp. stored<P, T>::type is the expression T cast to the element
+    // type of the destination P.
+    template<typename tag, typename T1, typename T2, typename Enable = void>
+    struct promoted_binary;
+
+    template<typename P, typename T, typename Enable = void>
+    struct stored;
+
     #define ARITHMETIC_ARRAY_CREATE_UNARY(NAME,TAG)\
     struct TAG { };\
     template<typename T1>\
@@ -60,9 +104,35 @@ namespace arrr {
         typedef std::tuple<TAG, T1, T2> type;\
     };\
     template<typename T1, typename T2>\
-    typename std::enable_if<is_node<T1>::value || is_node<T2>::value, std::tuple<TAG, typename store_type<T1>::type, typename store_type<T2>::type>>::type\
+    typename std::enable_if<is_node<T1>::value || is_node<T2>::value, typename promoted_binary<TAG, typename store_type<T1>::type, typename store_type<T2>::type>::type>::type\
     NAME(const T1 &a, const T2 &b) {\
-        return std::tuple<TAG, typename store_type<T1>::type, typename store_type<T2>::type>(TAG(), a, b);\
+        return promoted_binary<TAG, typename store_type<T1>::type, typename store_type<T2>::type>::apply(a, b);\
+    }
+
+    #define ARITHMETIC_ARRAY_CREATE_TERNARY(NAME,TAG)\
+    struct TAG { };\
+    template<typename T1, typename T2, typename T3>\
+    struct is_node<std::tuple<TAG, T1, T2, T3>> {\
+        static const bool value = true;\
+    };\
+    template<typename T1, typename T2, typename T3>\
+    struct store_type<std::tuple<TAG, T1, T2, T3>> {\
+        typedef std::tuple<TAG, T1, T2, T3> type;\
+    };\
+    template<typename T1, typename T2, typename T3>\
+    typename std::enable_if<is_node<T1>::value || is_node<T2>::value || is_node<T3>::value, std::tuple<TAG, typename store_type<T1>::type, typename store_type<T2>::type, typename store_type<T3>::type>>::type\
+    NAME(const T1 &a, const T2 &b, const T3 &c) {\
+        return std::tuple<TAG, typename store_type<T1>::type, typename store_type<T2>::type, typename store_type<T3>::type>(TAG(), a, b, c);\
+    }
+
+    // nodes are std::tuples, so comparing two nodes needs an overload that
+    // is more specialized than the relational operators of std::tuple
+    #define ARITHMETIC_ARRAY_CREATE_COMPARISON(NAME,TAG)\
+    ARITHMETIC_ARRAY_CREATE_BINARY(NAME,TAG)\
+    template<typename U1, typename... T1, typename U2, typename... T2>\
+    typename std::enable_if<is_node<std::tuple<U1, T1...>>::value || is_node<std::tuple<U2, T2...>>::value, typename promoted_binary<TAG, std::tuple<U1, T1...>, std::tuple<U2, T2...>>::type>::type\
+    NAME(const std::tuple<U1, T1...> &a, const std::tuple<U2, T2...> &b) {\
+        return promoted_binary<TAG, std::tuple<U1, T1...>, std::tuple<U2, T2...>>::apply(a, b);\
     }
 
     ARITHMETIC_ARRAY_CREATE_BINARY(operator+, add_tag)
@@ -73,9 +143,66 @@ namespace arrr {
     ARITHMETIC_ARRAY_CREATE_BINARY(max, max_tag)
 
     ARITHMETIC_ARRAY_CREATE_UNARY(sqrt, sqrt_tag)
-    ARITHMETIC_ARRAY_CREATE_UNARY(rsqrt, rsqrt_tag)
-    ARITHMETIC_ARRAY_CREATE_UNARY(rcp, rcp_tag)
 
+    // precision policies of rsqrt and rcp: fast_precision is the hardware
+    // estimate, refined_precision<steps> improves it by Newton-Raphson
+    // steps and exact_precision uses correctly rounded sqrt and division.
+    // The vector body and the scalar remainder honor the same policy.
+    struct fast_precision { };
+    template<int steps>
+    struct refined_precision { };
+    struct exact_precision { };
+
+    #define ARITHMETIC_ARRAY_CREATE_APPROXIMATION(NAME,TAG)\
+    template<typename precision>\
+    struct TAG { };\
+    template<typename precision, typename T1>\
+    struct is_node<std::tuple<TAG<precision>, T1>> {\
+        static const bool value = true;\
+    };\
+    template<typename precision, typename T1>\
+    struct store_type<std::tuple<TAG<precision>, T1>> {\
+        typedef std::tuple<TAG<precision>, T1> type;\
+    };\
+    template<typename precision = exact_precision, typename T1>\
+    typename std::enable_if<is_node<T1>::value, std::tuple<TAG<precision>, typename store_type<T1>::type>>::type\
+    NAME(const T1 &a) {\
+        return std::tuple<TAG<precision>, typename store_type<T1>::type>(TAG<precision>(), a);\
+    }
+
+    ARITHMETIC_ARRAY_CREATE_APPROXIMATION(rsqrt, rsqrt_tag)
+    ARITHMETIC_ARRAY_CREATE_APPROXIMATION(rcp, rcp_tag)
+
+    // elementary functions, see math.hpp for accuracy and domains
+    ARITHMETIC_ARRAY_CREATE_UNARY(exp, exp_tag)
+    ARITHMETIC_ARRAY_CREATE_UNARY(log, log_tag)
+    ARITHMETIC_ARRAY_CREATE_UNARY(sin, sin_tag)
+    ARITHMETIC_ARRAY_CREATE_UNARY(cos, cos_tag)
+    ARITHMETIC_ARRAY_CREATE_UNARY(tanh, tanh_tag)
+    ARITHMETIC_ARRAY_CREATE_BINARY(pow, pow_tag)
+
+    // fma(a,b,c) = a*b+c, fms(a,b,c) = a*b-c, fnma(a,b,c) = c-a*b
+    ARITHMETIC_ARRAY_CREATE_TERNARY(fma, fma_tag)
+    ARITHMETIC_ARRAY_CREATE_TERNARY(fms, fms_tag)
+    ARITHMETIC_ARRAY_CREATE_TERNARY(fnma, fnma_tag)
+
+    // comparisons produce masks: elements with all bits set for true and
+    // all bits clear for false. &&, || and ! combine masks and
+    // where(mask, a, b) selects a where the mask is set and b elsewhere.
+    ARITHMETIC_ARRAY_CREATE_COMPARISON(operator<, lt_tag)
+    ARITHMETIC_ARRAY_CREATE_COMPARISON(operator<=, le_tag)
+    ARITHMETIC_ARRAY_CREATE_COMPARISON(operator>, gt_tag)
+    ARITHMETIC_ARRAY_CREATE_COMPARISON(operator>=, ge_tag)
+    ARITHMETIC_ARRAY_CREATE_COMPARISON(operator==, eq_tag)
+    ARITHMETIC_ARRAY_CREATE_COMPARISON(operator!=, ne_tag)
+    ARITHMETIC_ARRAY_CREATE_BINARY(operator&&, and_tag)
+    ARITHMETIC_ARRAY_CREATE_BINARY(operator||, or_tag)
+    ARITHMETIC_ARRAY_CREATE_UNARY(operator!, not_tag)
+    ARITHMETIC_ARRAY_CREATE_TERNARY(where, select_tag)
+
+    #undef ARITHMETIC_ARRAY_CREATE_APPROXIMATION
+    #undef ARITHMETIC_ARRAY_CREATE_COMPARISON
+    #undef ARITHMETIC_ARRAY_CREATE_TERNARY
     #undef ARITHMETIC_ARRAY_CREATE_BINARY
     #undef ARITHMETIC_ARRAY_CREATE_UNARY
 
@@ -85,11 +212,144 @@ namespace arrr {
         static const bool value = true;
     };
     template<typename T1, typename T2>
-    std::tuple<store_tag, typename store_type<T1>::type, typename store_type<T2>::type>
+    std::tuple<store_tag, typename store_type<T1>::type, typename stored<T1, typename store_type<T2>::type>::type>
     store(const T1 &a, const T2 &b) {
-        return std::tuple<store_tag, typename store_type<T1>::type, typename store_type<T2>::type>(store_tag(), a, b);
+        return std::tuple<store_tag, typename store_type<T1>::type, typename stored<T1, typename store_type<T2>::type>::type>(store_tag(), a, stored<T1, typename store_type<T2>::type>::apply(b));
+    }
+
+    // stream nodes behave like store nodes but write with non-temporal stores
+    // that bypass the caches. finish() issues the fence that orders them.
+    struct stream_tag { };
+    template<typename T1, typename T2>
+    struct is_node<std::tuple<stream_tag, T1, T2>> {
+        static const bool value = true;
+    };
+    template<typename T1, typename T2>
+    std::tuple<stream_tag, typename store_type<T1>::type, typename stored<T1, typename store_type<T2>::type>::type>
+    stream(const T1 &a, const T2 &b) {
+        return std::tuple<stream_tag, typename store_type<T1>::type, typename stored<T1, typename store_type<T2>::type>::type>(stream_tag(), a, stored<T1, typename store_type<T2>::type>::apply(b));
+    }
+
+    // storeu nodes behave like store nodes but make no alignment assumptions
+    // about the destination.
+    struct storeu_tag { };
+    template<typename T1, typename T2>
+    struct is_node<std::tuple<storeu_tag, T1, T2>> {
+        static const bool value = true;
+    };
+    template<typename T1, typename T2>
+    std::tuple<storeu_tag, typename store_type<T1>::type, typename stored<T1, typename store_type<T2>::type>::type>
+    storeu(const T1 &a, const T2 &b) {
+        return std::tuple<storeu_tag, typename store_type<T1>::type, typename stored<T1, typename store_type<T2>::type>::type>(storeu_tag(), a, stored<T1, typename store_type<T2>::type>::apply(b));
+    }
+
+    // scatter nodes write the expression b to a[indices[i]] for every index
+    // i of the loop, scatter_add nodes add it to the element. Of repeated
+    // indices scatter keeps the value of the last one while scatter_add
+    // accumulates all of them in order.
+    template<bool accumulate>
+    struct scatter_tag { };
+    template<bool A, typename T1, typename T2>
+    struct is_node<std::tuple<scatter_tag<A>, T1, const int32_t*, T2>> {
+        static const bool value = true;
+    };
+    template<typename T1, typename T2>
+    std::tuple<scatter_tag<false>, T1*, const int32_t*, typename stored<T1*, typename store_type<T2>::type>::type>
+    scatter(T1 *a, const int32_t *indices, const T2 &b) {
+        return std::tuple<scatter_tag<false>, T1*, const int32_t*, typename stored<T1*, typename store_type<T2>::type>::type>(scatter_tag<false>(), a, indices, stored<T1*, typename store_type<T2>::type>::apply(b));
+    }
+    template<typename T1, typename T2>
+    std::tuple<scatter_tag<true>, T1*, const int32_t*, typename stored<T1*, typename store_type<T2>::type>::type>
+    scatter_add(T1 *a, const int32_t *indices, const T2 &b) {
+        return std::tuple<scatter_tag<true>, T1*, const int32_t*, typename stored<T1*, typename store_type<T2>::type>::type>(scatter_tag<true>(), a, indices, stored<T1*, typename store_type<T2>::type>::apply(b));
+    }
+
+    // store_strided nodes write the expression b to a[i*stride]
+    struct store_strided_tag { };
+    template<typename T1, typename T2>
+    struct is_node<std::tuple<store_strided_tag, T1, size_t, T2>> {
+        static const bool value = true;
+    };
+    template<typename T1, typename T2>
+    std::tuple<store_strided_tag, T1*, size_t, typename stored<T1*, typename store_type<T2>::type>::type>
+    store_strided(T1 *a, size_t stride, const T2 &b) {
+        return std::tuple<store_strided_tag, T1*, size_t, typename stored<T1*, typename store_type<T2>::type>::type>(store_strided_tag(), a, stride, stored<T1*, typename store_type<T2>::type>::apply(b));
+    }
+
+    // reduce nodes fold the expression into *a using the binary operation
+    // described by tag. Every unrolled root keeps its own accumulator pack
+    // which is combined horizontally in finish().
+    template<typename tag>
+    struct reduce_tag { };
+    template<typename tag, typename T1, typename T2>
+    struct is_node<std::tuple<reduce_tag<tag>, T1, T2>> {
+        static const bool value = true;
+    };
+    template<typename tag, typename T1, typename T2>
+    std::tuple<reduce_tag<tag>, T1*, typename store_type<T2>::type>
+    reduce(T1 *a, const T2 &b) {
+        return std::tuple<reduce_tag<tag>, T1*, typename store_type<T2>::type>(reduce_tag<tag>(), a, b);
+    }
+
+    // fuse nodes group store, storeu, stream and reduce statements over the
+    // same index range so a single loop evaluates all of them. Sources
+    // shared between the statements are streamed from memory only once.
+    struct fuse_tag { };
+    template<typename... Ts>
+    struct is_node<std::tuple<fuse_tag, std::tuple<Ts...>>> {
+        static const bool value = true;
+    };
+    template<typename... Ts>
+    struct store_type<std::tuple<fuse_tag, std::tuple<Ts...>>> {
+        typedef std::tuple<fuse_tag, std::tuple<Ts...>> type;
+    };
+    template<typename... Ts>
+    std::tuple<fuse_tag, std::tuple<Ts...>>
+    fuse(const Ts&... statements) {
+        return std::tuple<fuse_tag, std::tuple<Ts...>>(fuse_tag(), std::tuple<Ts...>(statements...));
+    }
+
+    // unroll<N>(expr) pins the number of roots the loop keeps in flight for
+    // the statement containing expr to N (1 to 16) instead of deriving it
+    // from register_need.
+    template<int N>
+    struct unroll_tag { };
+    template<int N, typename T1>
+    struct is_node<std::tuple<unroll_tag<N>, T1>> {
+        static const bool value = true;
+    };
+    template<int N, typename T1>
+    struct store_type<std::tuple<unroll_tag<N>, T1>> {
+        typedef std::tuple<unroll_tag<N>, T1> type;
+    };
+    template<int N, typename T1>
+    typename std::enable_if<is_node<T1>::value, std::tuple<unroll_tag<N>, typename store_type<T1>::type>>::type
+    unroll(const T1 &a) {
+        static_assert(N >= 1 && N <= 16, "unroll has to be between 1 and 16");
+        return std::tuple<unroll_tag<N>, typename store_type<T1>::type>(unroll_tag<N>(), a);
     }
 
+    template<typename tag, typename T>
+    struct reduce_identity;
+    template<typename T>
+    struct reduce_identity<add_tag, T> {
+        static T value() { return T(0); }
+    };
+    template<typename T>
+    struct reduce_identity<mul_tag, T> {
+        static T value() { return T(1); }
+    };
+    template<typename T>
+    struct reduce_identity<min_tag, T> {
+        static T value() { return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(); }
+    };
+    template<typename T>
+    struct reduce_identity<max_tag, T> {
+        static T value() { return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(); }
+    };
+
+#include "math.hpp"
+#include "half.hpp"
 #include "instruction_sets.hpp"
 
     template<typename T>
@@ -98,20 +358,280 @@ namespace arrr {
     template<typename T, typename U, typename model>
     struct array_eval_t;
 
+    template<typename T>
+    struct shared_loads;
+
 #include "loops.hpp"
+#include "thread_pool.hpp"
+
+    template<typename T>
+    struct register_need;
+
+    template<typename T>
+    struct pinned_unroll;
+
+    constexpr int need_max(int a, int b) { return a > b ? a : b; }
+    constexpr int need_min(int a, int b) { return a < b ? a : b; }
+
+    // unroll_factor is the number of roots that fit into the registers:
+    // while one root is computed every other one holds its loads (or its
+    // result), the constants are shared by all of them.
+    template<typename vector_model, typename T1>
+    struct unroll_factor {
+        typedef count<T1> stats;
+        static const int live = stats::loads > 1 ? stats::loads : 1;
+        static const int spare = int(vector_model::registers) - stats::immediates - register_need<T1>::value;
+        static const int value = pinned_unroll<T1>::value > 0 ? pinned_unroll<T1>::value : spare < 0 ? 1 : need_min(16, 1 + spare/live);
+    };
+
+    // executor runs the loops for a pair of instruction sets. It is the
+    // point where dispatch.hpp substitutes the instruction set selected at
+    // runtime. shared_loads may hand the loops a rewritten statement that
+    // loads repeated arrays only once.
+    template<typename vector_model, typename scalar_model>
+    struct executor {
+        struct dynamic_loop {
+            size_t end, begin;
+            template<typename T1>
+            void operator()(const T1 &expr) const {
+                loop<unroll_factor<vector_model, T1>::value>::template execute<vector_model, scalar_model>(expr, end, begin);
+            }
+        };
+        template<size_t N>
+        struct static_loop {
+            template<typename T1>
+            void operator()(const T1 &expr) const {
+                shortloop<vector_model, scalar_model, unroll_factor<vector_model, T1>::value, N>::template execute<>(expr);
+            }
+        };
+        template<typename T1>
+        static void run(T1 expr, size_t end, size_t begin = 0) {
+            shared_loads<T1>::run(expr, dynamic_loop{end, begin});
+        }
+        template<size_t N, typename T1>
+        static void run_static(T1 expr) {
+            shared_loads<T1>::run(expr, static_loop<N>());
+        }
+    };
+
+#if defined(ARRR_DISPATCH)
+#include "dispatch.hpp"
+#endif
 
     template<typename vector_model, typename scalar_model, typename T1>
     typename std::enable_if<is_node<T1>::value, void>::type execute(T1 expr, size_t N) {
-        typedef count<T1> stats;
-        loop<(vector_model::registers-stats::immediates)/(stats::loads==0?1:stats::loads)>::template execute<vector_model, scalar_model>(expr, N);
+        executor<vector_model, scalar_model>::run(expr, N);
     }
 
     template<typename vector_model, typename scalar_model, size_t N, typename T1>
     typename std::enable_if<is_node<T1>::value, void>::type static_execute(T1 expr) {
-        typedef count<T1> stats;
-        shortloop<vector_model, scalar_model, (vector_model::registers-stats::immediates)/(stats::loads==0?1:stats::loads), N>::template execute<>(expr);
+        executor<vector_model, scalar_model>::template run_static<N>(expr);
     }
 
+    // parallel_execute splits [0, N) into one chunk per pool thread. Chunk
+    // boundaries are multiples of the widest unrolled step so every chunk
+    // runs the same aligned loop as a serial execute would.
+    template<typename vector_model, typename scalar_model, typename T1>
+    typename std::enable_if<is_node<T1>::value, void>::type parallel_execute(T1 expr, size_t N, thread_pool &pool = default_thread_pool()) {
+        const size_t threads = pool.size();
+        if(threads < 2 || N < parallel_threshold()) {
+            execute<vector_model, scalar_model>(expr, N);
+            return;
+        }
+        const size_t granularity = 16*vector_model::pack_size;
+        const size_t chunk = ((N+threads-1)/threads+granularity-1)/granularity*granularity;
+        pool.run([&](size_t k) {
+            const size_t begin = std::min(N, k*chunk);
+            const size_t end = std::min(N, begin+chunk);
+            if(begin < end)
+                executor<vector_model, scalar_model>::run(expr, end, begin);
+        });
+    }
+
+    struct serial_policy {
+        template<typename vector_model, typename scalar_model, typename T1>
+        static void execute(T1 expr, size_t N) { arrr::execute<vector_model, scalar_model>(expr, N); }
+    };
+
+    struct parallel_policy {
+        template<typename vector_model, typename scalar_model, typename T1>
+        static void execute(T1 expr, size_t N) { arrr::parallel_execute<vector_model, scalar_model>(expr, N); }
+    };
+
+
+    // last_level_cache_size is the size in bytes of the largest data cache
+    // as reported by the system or 8MiB if that information is unavailable.
+    inline size_t last_level_cache_size() {
+        static const size_t size = []() -> size_t {
+            long bytes = 0;
+#if defined(_SC_LEVEL3_CACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+            bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+            if(bytes <= 0)
+                bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+            return bytes > 0 ? size_t(bytes) : size_t(8)<<20;
+        }();
+        return size;
+    }
+
+    // plain assignments to destinations of at least streaming_threshold()
+    // bytes use non-temporal stores since the result would not fit into the
+    // caches anyway. Compound assignments read their destination and always
+    // use regular stores.
+    inline size_t& streaming_threshold() {
+        static size_t threshold = last_level_cache_size();
+        return threshold;
+    }
+
+    template<typename policy, typename vector_model, typename scalar_model, typename T1, typename T2>
+    void stream_or_store(T1 *ptr, const T2 &rhs, size_t N) {
+        if(N*sizeof(T1) >= streaming_threshold())
+            policy::template execute<vector_model, scalar_model>(stream(ptr, rhs), N);
+        else
+            policy::template execute<vector_model, scalar_model>(store(ptr, rhs), N);
+    }
+
+    // indexed_view is the result of indexing an array with an array of
+    // int32_t indices. In expressions it reads base[indices[i]] (a gather),
+    // assigning to it writes there (a scatter). Of repeated indices the last
+    // one wins for =, while += and -= accumulate every occurrence. The right
+    // hand side must not read the elements that are written, and arrays a
+    // statement_queue writes must not be gathered from in the same queue.
+    template<typename T>
+    class indexed_view {
+    public:
+        typedef typename std::remove_const<T>::type value_type;
+        typedef std::size_t size_type;
+        typedef T* pointer;
+        typedef vector_instruction_set<value_type> vector_model;
+        typedef scalar_instruction_set<value_type> scalar_model;
+
+        indexed_view(pointer base, const int32_t *indices, size_type size) : size_(size), base_(base), indices_(indices) { }
+        indexed_view(const indexed_view&) = default;
+
+        size_type size() const { return size_; }
+        pointer base() const { return base_; }
+        const int32_t* indices() const { return indices_; }
+
+        indexed_view& operator=(const indexed_view &rhs) {
+            execute<vector_model, scalar_model>(scatter(base_, indices_, rhs), size_);
+            return *this;
+        }
+        template<typename T1>
+        indexed_view& operator=(const T1 &rhs) {
+            execute<vector_model, scalar_model>(scatter(base_, indices_, rhs), size_);
+            return *this;
+        }
+        template<typename T1>
+        indexed_view& operator+=(const T1 &rhs) {
+            execute<vector_model, scalar_model>(scatter_add(base_, indices_, rhs), size_);
+            return *this;
+        }
+        template<typename T1>
+        indexed_view& operator-=(const T1 &rhs) {
+            execute<vector_model, scalar_model>(scatter_add(base_, indices_, value_type(0) - rhs), size_);
+            return *this;
+        }
+    private:
+        size_type size_;
+        pointer base_;
+        const int32_t *indices_;
+    };
+
+    template<typename T>
+    struct is_node<indexed_view<T>> {
+        static const bool value = true;
+    };
+
+    template<typename T>
+    struct store_type<indexed_view<T>> {
+        typedef indexed_view<T> type;
+    };
+
+    // strided_view is a view of size elements that are stride elements
+    // apart, like one coordinate of interleaved xyz data. Loads and stores
+    // use gather and scatter instructions where the instruction set has
+    // them and go element by element otherwise. The offsets of a pack are
+    // computed in 32 bit, so stride*pack_size has to fit into an int32_t.
+    template<typename T>
+    class strided_view {
+    public:
+        typedef typename std::remove_const<T>::type value_type;
+        typedef std::size_t size_type;
+        typedef T& reference;
+        typedef T* pointer;
+        typedef vector_instruction_set<value_type> vector_model;
+        typedef scalar_instruction_set<value_type> scalar_model;
+
+        strided_view(pointer data, size_type size, size_type stride) : size_(size), stride_(stride), data_(data) { }
+        strided_view(const strided_view&) = default;
+
+        size_type size() const { return size_; }
+        size_type stride() const { return stride_; }
+        pointer data() const { return data_; }
+        reference operator[](size_type i) const { return data_[i*stride_]; }
+
+        strided_view& operator=(const strided_view &rhs) {
+            update<serial_policy>(rhs);
+            return *this;
+        }
+        template<typename T1>
+        strided_view& operator=(const T1 &rhs) {
+            update<serial_policy>(rhs);
+            return *this;
+        }
+        template<typename T1>
+        strided_view& operator+=(const T1 &rhs) {
+            update<serial_policy>(*this + rhs);
+            return *this;
+        }
+        template<typename T1>
+        strided_view& operator-=(const T1 &rhs) {
+            update<serial_policy>(*this - rhs);
+            return *this;
+        }
+        template<typename T1>
+        strided_view& operator*=(const T1 &rhs) {
+            update<serial_policy>(*this * rhs);
+            return *this;
+        }
+        template<typename T1>
+        strided_view& operator/=(const T1 &rhs) {
+            update<serial_policy>(*this / rhs);
+            return *this;
+        }
+
+        template<typename policy, typename T1>
+        void assign(const T1 &rhs) {
+            update<policy>(rhs);
+        }
+        template<typename policy, typename T1>
+        void update(const T1 &rhs) {
+            policy::template execute<vector_model, scalar_model>(store_strided(data_, stride_, rhs), size_);
+        }
+    private:
+        size_type size_;
+        size_type stride_;
+        pointer data_;
+    };
+
+    template<typename T>
+    struct is_node<strided_view<T>> {
+        static const bool value = true;
+    };
+
+    template<typename T>
+    struct store_type<strided_view<T>> {
+        typedef strided_view<T> type;
+    };
+
+    template<typename T>
+    class array_view;
+
+    // rebase<T>::apply(node, offset) is node with every array starting offset
+    // elements later
+    template<typename T, typename Enable = void>
+    struct rebase;
 
     template<typename T, size_t size_ = 0>
     class arithmetic_array {
@@ -125,8 +645,8 @@ namespace arrr {
         typedef const T* const_pointer;
         typedef T* iterator;
         typedef const T* const_iterator;
-        typedef vector_instruction_set<T> vector_model;
-        typedef scalar_instruction_set<T> scalar_model;
+        typedef vector_instruction_set<typename compute_type<T>::type> vector_model;
+        typedef scalar_instruction_set<typename compute_type<T>::type> scalar_model;
 
         explicit arithmetic_array(T val = T()) {
             std::fill(data_, data_+size_, val);
@@ -137,6 +657,16 @@ namespace arrr {
         const_pointer data() const { return data_; }
         reference operator[](size_type i) { return data_[i]; }
         const_reference operator[](size_type i) const { return data_[i]; }
+        template<size_t M>
+        indexed_view<T> operator[](const arithmetic_array<int32_t,M> &indices) { return indexed_view<T>(data(), indices.data(), indices.size()); }
+        template<size_t M>
+        indexed_view<const T> operator[](const arithmetic_array<int32_t,M> &indices) const { return indexed_view<const T>(data(), indices.data(), indices.size()); }
+        // slice(begin, end) views the elements [begin, end) and
+        // slice(begin, end, step) every step-th of them
+        array_view<T> slice(size_type begin, size_type end) { return array_view<T>(data()+begin, end-begin); }
+        array_view<const T> slice(size_type begin, size_type end) const { return array_view<const T>(data()+begin, end-begin); }
+        strided_view<T> slice(size_type begin, size_type end, size_type step) { return strided_view<T>(data()+begin, (end-begin+step-1)/step, step); }
+        strided_view<const T> slice(size_type begin, size_type end, size_type step) const { return strided_view<const T>(data()+begin, (end-begin+step-1)/step, step); }
         iterator begin() { return data_; }
         iterator end() { return data_+size_; }
         const_iterator begin() const { return data_; }
@@ -172,6 +702,17 @@ namespace arrr {
             static_execute<vector_model, scalar_model,size_>(store(static_cast<pointer>(data_), *this / rhs));
             return *this;
         }
+
+        // assign and update evaluate rhs into the array through an execution
+        // policy. update is used when rhs reads the array itself.
+        template<typename policy, typename T1>
+        void assign(const T1 &rhs) {
+            policy::template execute<vector_model, scalar_model>(store(static_cast<pointer>(data_), rhs), size_);
+        }
+        template<typename policy, typename T1>
+        void update(const T1 &rhs) {
+            policy::template execute<vector_model, scalar_model>(store(static_cast<pointer>(data_), rhs), size_);
+        }
     private:
         arithmetic_array(const arithmetic_array&) = delete;
 
@@ -190,8 +731,8 @@ namespace arrr {
         typedef const T* const_pointer;
         typedef T* iterator;
         typedef const T* const_iterator;
-        typedef vector_instruction_set<T> vector_model;
-        typedef scalar_instruction_set<T> scalar_model;
+        typedef vector_instruction_set<typename compute_type<T>::type> vector_model;
+        typedef scalar_instruction_set<typename compute_type<T>::type> scalar_model;
 
         explicit arithmetic_array(size_t size, T val = T())
         : size_(size), data_(static_cast<T*>(_mm_malloc(size_*sizeof(T), vector_model::alignment)), &_mm_free)
@@ -204,6 +745,16 @@ namespace arrr {
         const_pointer data() const { return data_.get(); }
         reference operator[](size_type i) { return data_[i]; }
         const_reference operator[](size_type i) const { return data_[i]; }
+        template<size_t M>
+        indexed_view<T> operator[](const arithmetic_array<int32_t,M> &indices) { return indexed_view<T>(data(), indices.data(), indices.size()); }
+        template<size_t M>
+        indexed_view<const T> operator[](const arithmetic_array<int32_t,M> &indices) const { return indexed_view<const T>(data(), indices.data(), indices.size()); }
+        // slice(begin, end) views the elements [begin, end) and
+        // slice(begin, end, step) every step-th of them
+        array_view<T> slice(size_type begin, size_type end) { return array_view<T>(data()+begin, end-begin); }
+        array_view<const T> slice(size_type begin, size_type end) const { return array_view<const T>(data()+begin, end-begin); }
+        strided_view<T> slice(size_type begin, size_type end, size_type step) { return strided_view<T>(data()+begin, (end-begin+step-1)/step, step); }
+        strided_view<const T> slice(size_type begin, size_type end, size_type step) const { return strided_view<const T>(data()+begin, (end-begin+step-1)/step, step); }
         iterator begin() { return data_.get(); }
         iterator end() { return data_.get()+size_; }
         const_iterator begin() const { return data_.get(); }
@@ -211,12 +762,12 @@ namespace arrr {
         void swap(arithmetic_array &other) { data_.swap(other.data_); std::swap(size_, other.size_); }
 
         arithmetic_array& operator=(const arithmetic_array &rhs) {
-            execute<vector_model, scalar_model>(store(data_.get(), rhs), size_);
+            assign<serial_policy>(rhs);
             return *this;
         }
         template<typename T1>
         arithmetic_array& operator=(const T1 &rhs) {
-            execute<vector_model, scalar_model>(store(data_.get(), rhs), size_);
+            assign<serial_policy>(rhs);
             return *this;
         }
         template<typename T1>
@@ -239,10 +790,21 @@ namespace arrr {
             execute<vector_model, scalar_model>(store(data_.get(), *this / rhs), size_);
             return *this;
         }
+
+        // assign and update evaluate rhs into the array through an execution
+        // policy. update is used when rhs reads the array itself.
+        template<typename policy, typename T1>
+        void assign(const T1 &rhs) {
+            stream_or_store<policy, vector_model, scalar_model>(data_.get(), rhs, size_);
+        }
+        template<typename policy, typename T1>
+        void update(const T1 &rhs) {
+            policy::template execute<vector_model, scalar_model>(store(data_.get(), rhs), size_);
+        }
     private:
         arithmetic_array(const arithmetic_array&) = delete;
 
-        const size_type size_;
+        size_type size_;
         std::unique_ptr<value_type[],void(*)(void*)> data_;
     };
 
@@ -251,45 +813,428 @@ namespace arrr {
         static const bool value = true;
     };
 
-
+    // array_view is a non-owning view of size elements of memory owned by
+    // someone else. It takes part in expressions like arithmetic_array but
+    // uses unaligned loads and stores so any pointer can be wrapped.
+    // Copying a view is cheap and aliases the same memory, assigning to a
+    // view assigns the elements.
     template<typename T>
-    struct count {
-        static const int loads = 0;
-        static const int stores = 0;
-        static const int operations = 0;
-        static const int immediates = 1;
+    class array_view {
+    public:
+        typedef typename std::remove_const<T>::type value_type;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T* iterator;
+        typedef const T* const_iterator;
+        typedef vector_instruction_set<typename compute_type<value_type>::type> vector_model;
+        typedef scalar_instruction_set<typename compute_type<value_type>::type> scalar_model;
+
+        array_view(pointer data, size_type size) : size_(size), data_(data) { }
+        array_view(const array_view&) = default;
+
+        size_type size() const { return size_; }
+        pointer data() const { return data_; }
+        reference operator[](size_type i) const { return data_[i]; }
+        template<size_t M>
+        indexed_view<T> operator[](const arithmetic_array<int32_t,M> &indices) const { return indexed_view<T>(data_, indices.data(), indices.size()); }
+        array_view slice(size_type begin, size_type end) const { return array_view(data_+begin, end-begin); }
+        strided_view<T> slice(size_type begin, size_type end, size_type step) const { return strided_view<T>(data_+begin, (end-begin+step-1)/step, step); }
+        iterator begin() const { return data_; }
+        iterator end() const { return data_+size_; }
+
+        array_view& operator=(const array_view &rhs) {
+            update<serial_policy>(rhs);
+            return *this;
+        }
+        template<typename T1>
+        array_view& operator=(const T1 &rhs) {
+            update<serial_policy>(rhs);
+            return *this;
+        }
+        template<typename T1>
+        array_view& operator+=(const T1 &rhs) {
+            update<serial_policy>(*this + rhs);
+            return *this;
+        }
+        template<typename T1>
+        array_view& operator-=(const T1 &rhs) {
+            update<serial_policy>(*this - rhs);
+            return *this;
+        }
+        template<typename T1>
+        array_view& operator*=(const T1 &rhs) {
+            update<serial_policy>(*this * rhs);
+            return *this;
+        }
+        template<typename T1>
+        array_view& operator/=(const T1 &rhs) {
+            update<serial_policy>(*this / rhs);
+            return *this;
+        }
+
+        template<typename policy, typename T1>
+        void assign(const T1 &rhs) {
+            update<policy>(rhs);
+        }
+        // the elements in front of the first aligned one are computed on
+        // their own so the loop can use aligned stores. The sources are
+        // shifted along with the destination and read unaligned.
+        template<typename policy, typename T1>
+        void update(const T1 &rhs) {
+            const size_t misalignment = reinterpret_cast<uintptr_t>(data_) % vector_model::alignment;
+            const size_t head = std::min(size_, (vector_model::alignment - misalignment) % vector_model::alignment / sizeof(value_type));
+            if(misalignment % sizeof(value_type) != 0) {
+                policy::template execute<vector_model, scalar_model>(storeu(data_, rhs), size_);
+            } else if(head == 0) {
+                policy::template execute<vector_model, scalar_model>(store(data_, rhs), size_);
+            } else {
+                remainder<scalar_model, scalar_model>::execute(storeu(data_, rhs), 0, head);
+                policy::template execute<vector_model, scalar_model>(store(data_+head, rebase<typename store_type<T1>::type>::apply(rhs, head)), size_-head);
+            }
+        }
+    private:
+        size_type size_;
+        pointer data_;
     };
 
-    template<typename T, size_t N>
-    struct count<const arithmetic_array<T,N>&> {
-        static const int loads = 1;
-        static const int stores = 0;
-        static const int operations = 0;
-        static const int immediates = 0;
+    template<typename T>
+    struct is_node<array_view<T>> {
+        static const bool value = true;
     };
 
-    template<typename T1, typename T2>
-    struct count<std::tuple<store_tag, T1, T2>> {
-        static const int loads = count<T2>::loads;
-        static const int stores = count<T2>::stores + 1;
-        static const int operations = count<T2>::operations;
-        static const int immediates = count<T2>::immediates;
+    // views are stored by value in expressions so temporaries can be used
+    template<typename T>
+    struct store_type<array_view<T>> {
+        typedef array_view<T> type;
     };
 
-    template<typename tag, typename T1>
-    struct count<std::tuple<tag, T1>> {
-        static const int loads = count<T1>::loads;
-        static const int stores = count<T1>::stores;
-        static const int operations = count<T1>::operations+1;
-        static const int immediates = count<T1>::immediates;
+    template<typename T, typename Enable>
+    struct rebase {
+        typedef T type;
+        static type apply(const typename std::remove_reference<T>::type &node, size_t) { return node; }
     };
 
-    template<typename tag, typename T1, typename T2>
-    struct count<std::tuple<tag, T1, T2>> {
-        static const int loads = count<T1>::loads+count<T2>::loads;
-        static const int stores = count<T1>::stores+count<T2>::stores;
-        static const int operations = count<T1>::operations+count<T2>::operations+1;
-        static const int immediates = count<T1>::immediates+count<T2>::immediates;
+    template<typename T, size_t N>
+    struct rebase<const arithmetic_array<T,N>&> {
+        typedef array_view<const T> type;
+        static type apply(const arithmetic_array<T,N> &node, size_t offset) { return type(node.data()+offset, node.size()-std::min(offset, node.size())); }
+    };
+
+    template<typename T>
+    struct rebase<array_view<T>> {
+        typedef array_view<T> type;
+        static type apply(const array_view<T> &node, size_t offset) { return type(node.data()+offset, node.size()-std::min(offset, node.size())); }
+    };
+
+    template<typename T>
+    struct rebase<strided_view<T>> {
+        typedef strided_view<T> type;
+        static type apply(const strided_view<T> &node, size_t offset) { return type(node.data()+offset*node.stride(), node.size()-std::min(offset, node.size()), node.stride()); }
+    };
+
+    template<typename T>
+    struct rebase<indexed_view<T>> {
+        typedef indexed_view<T> type;
+        static type apply(const indexed_view<T> &node, size_t offset) { return type(node.base(), node.indices()+offset, node.size()-std::min(offset, node.size())); }
+    };
+
+    template<typename tag, typename T1>
+    struct rebase<std::tuple<tag, T1>> {
+        typedef std::tuple<tag, typename rebase<T1>::type> type;
+        static type apply(const std::tuple<tag, T1> &node, size_t offset) {
+            return type(std::get<0>(node), rebase<T1>::apply(std::get<1>(node), offset));
+        }
+    };
+
+    template<typename tag, typename T1, typename T2>
+    struct rebase<std::tuple<tag, T1, T2>> {
+        typedef std::tuple<tag, typename rebase<T1>::type, typename rebase<T2>::type> type;
+        static type apply(const std::tuple<tag, T1, T2> &node, size_t offset) {
+            return type(std::get<0>(node), rebase<T1>::apply(std::get<1>(node), offset), rebase<T2>::apply(std::get<2>(node), offset));
+        }
+    };
+
+    template<typename tag, typename T1, typename T2, typename T3>
+    struct rebase<std::tuple<tag, T1, T2, T3>> {
+        typedef std::tuple<tag, typename rebase<T1>::type, typename rebase<T2>::type, typename rebase<T3>::type> type;
+        static type apply(const std::tuple<tag, T1, T2, T3> &node, size_t offset) {
+            return type(std::get<0>(node), rebase<T1>::apply(std::get<1>(node), offset), rebase<T2>::apply(std::get<2>(node), offset), rebase<T3>::apply(std::get<3>(node), offset));
+        }
+    };
+
+
+    template<typename T>
+    struct count {
+        static const int loads = 0;
+        static const int stores = 0;
+        static const int operations = 0;
+        static const int immediates = 1;
+    };
+
+    template<typename T, size_t N>
+    struct count<const arithmetic_array<T,N>&> {
+        static const int loads = 1;
+        static const int stores = 0;
+        static const int operations = 0;
+        static const int immediates = 0;
+    };
+
+    template<typename T>
+    struct count<array_view<T>> {
+        static const int loads = 1;
+        static const int stores = 0;
+        static const int operations = 0;
+        static const int immediates = 0;
+    };
+
+    template<typename T1, typename T2>
+    struct count<std::tuple<storeu_tag, T1, T2>> {
+        static const int loads = count<T2>::loads;
+        static const int stores = count<T2>::stores + 1;
+        static const int operations = count<T2>::operations;
+        static const int immediates = count<T2>::immediates;
+    };
+
+    template<typename T1, typename T2>
+    struct count<std::tuple<store_tag, T1, T2>> {
+        static const int loads = count<T2>::loads;
+        static const int stores = count<T2>::stores + 1;
+        static const int operations = count<T2>::operations;
+        static const int immediates = count<T2>::immediates;
+    };
+
+    template<typename tag, typename T1>
+    struct count<std::tuple<tag, T1>> {
+        static const int loads = count<T1>::loads;
+        static const int stores = count<T1>::stores;
+        static const int operations = count<T1>::operations+1;
+        static const int immediates = count<T1>::immediates;
+    };
+
+    template<typename tag, typename T1, typename T2>
+    struct count<std::tuple<tag, T1, T2>> {
+        static const int loads = count<T1>::loads+count<T2>::loads;
+        static const int stores = count<T1>::stores+count<T2>::stores;
+        static const int operations = count<T1>::operations+count<T2>::operations+1;
+        static const int immediates = count<T1>::immediates+count<T2>::immediates;
+    };
+
+    template<typename tag, typename T1, typename T2, typename T3>
+    struct count<std::tuple<tag, T1, T2, T3>> {
+        static const int loads = count<T1>::loads+count<T2>::loads+count<T3>::loads;
+        static const int stores = count<T1>::stores+count<T2>::stores+count<T3>::stores;
+        static const int operations = count<T1>::operations+count<T2>::operations+count<T3>::operations+1;
+        static const int immediates = count<T1>::immediates+count<T2>::immediates+count<T3>::immediates;
+    };
+
+    // the statements of a fuse node are evaluated side by side, so their
+    // register demands add up
+    template<typename... Ts>
+    struct count<std::tuple<fuse_tag, std::tuple<Ts...>>> {
+        static const int loads = 0;
+        static const int stores = 0;
+        static const int operations = 0;
+        static const int immediates = 0;
+    };
+
+    template<typename T, typename... Ts>
+    struct count<std::tuple<fuse_tag, std::tuple<T, Ts...>>> {
+        typedef count<std::tuple<fuse_tag, std::tuple<Ts...>>> rest;
+        static const int loads = count<T>::loads + rest::loads;
+        static const int stores = count<T>::stores + rest::stores;
+        static const int operations = count<T>::operations + rest::operations;
+        static const int immediates = count<T>::immediates + rest::immediates;
+    };
+
+    template<typename T1, typename T2>
+    struct count<std::tuple<stream_tag, T1, T2>> {
+        static const int loads = count<T2>::loads;
+        static const int stores = count<T2>::stores + 1;
+        static const int operations = count<T2>::operations;
+        static const int immediates = count<T2>::immediates;
+    };
+
+    template<typename tag, typename T1, typename T2>
+    struct count<std::tuple<reduce_tag<tag>, T1, T2>> {
+        // the accumulator occupies a register in every root just like a load
+        static const int loads = count<T2>::loads + 1;
+        static const int stores = count<T2>::stores;
+        static const int operations = count<T2>::operations + 1;
+        static const int immediates = count<T2>::immediates;
+    };
+
+    template<int N, typename T1>
+    struct count<std::tuple<unroll_tag<N>, T1>> : count<T1> { };
+
+    template<typename T>
+    struct count<indexed_view<T>> {
+        static const int loads = 1;
+        static const int stores = 0;
+        static const int operations = 0;
+        static const int immediates = 0;
+    };
+
+    template<typename T>
+    struct count<strided_view<T>> {
+        static const int loads = 1;
+        static const int stores = 0;
+        static const int operations = 0;
+        static const int immediates = 0;
+    };
+
+    template<typename T1, typename T2>
+    struct count<std::tuple<store_strided_tag, T1, size_t, T2>> {
+        static const int loads = count<T2>::loads;
+        static const int stores = count<T2>::stores + 1;
+        static const int operations = count<T2>::operations;
+        static const int immediates = count<T2>::immediates;
+    };
+
+    template<bool A, typename T1, typename T2>
+    struct count<std::tuple<scatter_tag<A>, T1, const int32_t*, T2>> {
+        static const int loads = count<T2>::loads;
+        static const int stores = count<T2>::stores + 1;
+        static const int operations = count<T2>::operations;
+        static const int immediates = count<T2>::immediates;
+    };
+
+    // scratch_registers is the number of temporaries an operation needs on
+    // top of its operands and result. The elementary functions keep a few
+    // partial results live, their coefficients are memory operands.
+    template<typename tag>
+    struct scratch_registers {
+        static const int value = 0;
+    };
+    template<> struct scratch_registers<exp_tag> { static const int value = 3; };
+    template<> struct scratch_registers<log_tag> { static const int value = 4; };
+    template<> struct scratch_registers<sin_tag> { static const int value = 4; };
+    template<> struct scratch_registers<cos_tag> { static const int value = 4; };
+    template<> struct scratch_registers<tanh_tag> { static const int value = 4; };
+    template<> struct scratch_registers<pow_tag> { static const int value = 5; };
+    template<int steps> struct scratch_registers<rsqrt_tag<refined_precision<steps>>> { static const int value = 2; };
+    template<int steps> struct scratch_registers<rcp_tag<refined_precision<steps>>> { static const int value = 1; };
+
+    // register_need is the number of vector registers one root needs to
+    // compute its value (Sethi-Ullman numbering). A root issues all of its
+    // loads before any operation, so the loads of the children evaluated
+    // later stay live while the first one is computed, and the children are
+    // evaluated in the cheapest order. Constants live in registers shared by
+    // all roots and are counted by count<>::immediates instead.
+    constexpr int binary_need(int n1, int l1, int n2, int l2) {
+        return need_min(need_max(n1+l2, 1+n2), need_max(n2+l1, 1+n1));
+    }
+    constexpr int ternary_order(int n1, int n2, int l2, int n3, int l3) {
+        return need_max(n1+l2+l3, need_max(1+n2+l3, 2+n3));
+    }
+    constexpr int ternary_need(int n1, int l1, int n2, int l2, int n3, int l3) {
+        return need_min(need_min(ternary_order(n1, n2, l2, n3, l3), ternary_order(n1, n3, l3, n2, l2)),
+               need_min(need_min(ternary_order(n2, n1, l1, n3, l3), ternary_order(n2, n3, l3, n1, l1)),
+                        need_min(ternary_order(n3, n1, l1, n2, l2), ternary_order(n3, n2, l2, n1, l1))));
+    }
+
+    template<typename T>
+    struct register_need {
+        static const int value = 0;
+    };
+
+    template<typename T, size_t N>
+    struct register_need<const arithmetic_array<T,N>&> {
+        static const int value = 1;
+    };
+
+    template<typename T>
+    struct register_need<array_view<T>> {
+        static const int value = 1;
+    };
+
+    template<typename tag, typename T1>
+    struct register_need<std::tuple<tag, T1>> {
+        static const int value = need_max(1, register_need<T1>::value) + scratch_registers<tag>::value;
+    };
+
+    template<typename tag, typename T1, typename T2>
+    struct register_need<std::tuple<tag, T1, T2>> {
+        static const int value = need_max(1, binary_need(
+            register_need<T1>::value, count<T1>::loads,
+            register_need<T2>::value, count<T2>::loads)) + scratch_registers<tag>::value;
+    };
+
+    template<typename tag, typename T1, typename T2, typename T3>
+    struct register_need<std::tuple<tag, T1, T2, T3>> {
+        static const int value = need_max(1, ternary_need(
+            register_need<T1>::value, count<T1>::loads,
+            register_need<T2>::value, count<T2>::loads,
+            register_need<T3>::value, count<T3>::loads)) + scratch_registers<tag>::value;
+    };
+
+    template<typename tag, typename T1, typename T2>
+    struct register_need<std::tuple<reduce_tag<tag>, T1, T2>> {
+        static const int value = register_need<T2>::value + 1;
+    };
+
+    template<int N, typename T1>
+    struct register_need<std::tuple<unroll_tag<N>, T1>> : register_need<T1> { };
+
+    // gathers and scatters hold the indices or offsets in a register next
+    // to the values
+    template<typename T>
+    struct register_need<indexed_view<T>> {
+        static const int value = 2;
+    };
+
+    template<bool A, typename T1, typename T2>
+    struct register_need<std::tuple<scatter_tag<A>, T1, const int32_t*, T2>> {
+        static const int value = need_max(1, register_need<T2>::value) + 1;
+    };
+
+    template<typename T>
+    struct register_need<strided_view<T>> {
+        static const int value = 2;
+    };
+
+    template<typename T1, typename T2>
+    struct register_need<std::tuple<store_strided_tag, T1, size_t, T2>> {
+        static const int value = need_max(1, register_need<T2>::value) + 1;
+    };
+
+    // the statements of a fuse node run one after the other: the first one
+    // is computed while the loads of the others are live, after that its
+    // result is kept until the store phase
+    template<typename... Ts>
+    struct fused_need {
+        static const int value = 0;
+        static const int loads = 0;
+    };
+
+    template<typename T, typename... Ts>
+    struct fused_need<T, Ts...> {
+        typedef fused_need<Ts...> rest;
+        static const int loads = count<T>::loads + rest::loads;
+        static const int value = need_max(register_need<T>::value + rest::loads, 1 + rest::value);
+    };
+
+    template<typename... Ts>
+    struct register_need<std::tuple<fuse_tag, std::tuple<Ts...>>> {
+        static const int value = fused_need<Ts...>::value;
+    };
+
+    template<typename T>
+    struct pinned_unroll {
+        static const int value = 0;
+    };
+
+    template<typename T, typename... Ts>
+    struct pinned_unroll<std::tuple<T, Ts...>> {
+        static const int value = need_max(pinned_unroll<T>::value, pinned_unroll<std::tuple<Ts...>>::value);
+    };
+
+    template<int N, typename T1>
+    struct pinned_unroll<std::tuple<unroll_tag<N>, T1>> {
+        static const int value = N;
     };
 
     template<typename T, typename U, typename model>
@@ -299,6 +1244,7 @@ namespace arrr {
         void prepare(const T &node) { tmp = model::set(node); }
         void load(const T &, const U&) { }
         void store(const T &, const U&) { }
+        void finish(const T &) { }
         return_type operator()(const T&, const U&) {
             return tmp;
         }
@@ -313,6 +1259,7 @@ namespace arrr {
         void prepare(const arithmetic_array<T1,N> &node) { ptr = node.data(); }
         void load(const arithmetic_array<T1,N>&, const U &userdata) { tmp = model::load(ptr, userdata); }
         void store(const arithmetic_array<T1,N> &, const U &) { }
+        void finish(const arithmetic_array<T1,N> &) { }
         return_type operator()(const arithmetic_array<T1,N> &, const U &) {
             return tmp;
         }
@@ -337,11 +1284,173 @@ namespace arrr {
             right.store(std::get<2>(node), userdata);
             model::store(ptr, userdata, tmp);
         }
+        void finish(const std::tuple<store_tag, T1, T2> &node) {
+            right.finish(std::get<2>(node));
+        }
         return_type operator()(const std::tuple<store_tag, T1, T2> &node, const U& userdata) {
             return tmp = right(std::get<2>(node), userdata);
         }
     };
 
+    template<typename T1, typename U, typename model>
+    struct array_eval_t<array_view<T1>,U,model> {
+        typedef typename model::pack_type return_type;
+        return_type tmp;
+        const typename array_view<T1>::value_type *ptr;
+        void prepare(const array_view<T1> &node) { ptr = node.data(); }
+        void load(const array_view<T1>&, const U &userdata) { tmp = model::loadu(ptr, userdata); }
+        void store(const array_view<T1> &, const U &) { }
+        void finish(const array_view<T1> &) { }
+        return_type operator()(const array_view<T1> &, const U &) {
+            return tmp;
+        }
+    };
+
+    template<typename T1, typename U, typename model>
+    struct array_eval_t<indexed_view<T1>,U,model> {
+        typedef typename model::pack_type return_type;
+        return_type tmp;
+        const typename indexed_view<T1>::value_type *base;
+        const int32_t *indices;
+        void prepare(const indexed_view<T1> &node) { base = node.base(); indices = node.indices(); }
+        void load(const indexed_view<T1>&, const U &userdata) { tmp = model::gather(base, indices, userdata); }
+        void store(const indexed_view<T1> &, const U &) { }
+        void finish(const indexed_view<T1> &) { }
+        return_type operator()(const indexed_view<T1> &, const U &) {
+            return tmp;
+        }
+    };
+
+    template<typename T1, typename U, typename model>
+    struct array_eval_t<strided_view<T1>,U,model> {
+        typedef typename model::pack_type return_type;
+        return_type tmp;
+        const typename strided_view<T1>::value_type *ptr;
+        size_t stride;
+        void prepare(const strided_view<T1> &node) { ptr = node.data(); stride = node.stride(); }
+        void load(const strided_view<T1>&, const U &userdata) { tmp = model::load_strided(ptr, userdata, stride); }
+        void store(const strided_view<T1> &, const U &) { }
+        void finish(const strided_view<T1> &) { }
+        return_type operator()(const strided_view<T1> &, const U &) {
+            return tmp;
+        }
+    };
+
+    template<typename T1, typename T2, typename U, typename model>
+    struct array_eval_t<std::tuple<store_strided_tag, T1, size_t, T2>,U,model> {
+        typedef typename model::pack_type return_type;
+        return_type tmp;
+        T1 ptr;
+        size_t stride;
+
+        array_eval_t<T2,U,model> right;
+
+        void prepare(const std::tuple<store_strided_tag, T1, size_t, T2> &node) {
+            right.prepare(std::get<3>(node));
+            ptr = std::get<1>(node);
+            stride = std::get<2>(node);
+        }
+        void load(const std::tuple<store_strided_tag, T1, size_t, T2> &node, const U& userdata) {
+            right.load(std::get<3>(node), userdata);
+        }
+        void store(const std::tuple<store_strided_tag, T1, size_t, T2> &node, const U& userdata) {
+            right.store(std::get<3>(node), userdata);
+            model::store_strided(ptr, userdata, stride, tmp);
+        }
+        void finish(const std::tuple<store_strided_tag, T1, size_t, T2> &node) {
+            right.finish(std::get<3>(node));
+        }
+        return_type operator()(const std::tuple<store_strided_tag, T1, size_t, T2> &node, const U& userdata) {
+            return tmp = right(std::get<3>(node), userdata);
+        }
+    };
+
+    template<bool A, typename T1, typename T2, typename U, typename model>
+    struct array_eval_t<std::tuple<scatter_tag<A>, T1, const int32_t*, T2>,U,model> {
+        typedef typename model::pack_type return_type;
+        return_type tmp;
+        T1 ptr;
+        const int32_t *indices;
+
+        array_eval_t<T2,U,model> right;
+
+        void prepare(const std::tuple<scatter_tag<A>, T1, const int32_t*, T2> &node) {
+            right.prepare(std::get<3>(node));
+            ptr = std::get<1>(node);
+            indices = std::get<2>(node);
+        }
+        void load(const std::tuple<scatter_tag<A>, T1, const int32_t*, T2> &node, const U& userdata) {
+            right.load(std::get<3>(node), userdata);
+        }
+        void store(const std::tuple<scatter_tag<A>, T1, const int32_t*, T2> &node, const U& userdata) {
+            right.store(std::get<3>(node), userdata);
+            if(A)
+                model::scatter_add(ptr, indices, userdata, tmp);
+            else
+                model::scatter(ptr, indices, userdata, tmp);
+        }
+        void finish(const std::tuple<scatter_tag<A>, T1, const int32_t*, T2> &node) {
+            right.finish(std::get<3>(node));
+        }
+        return_type operator()(const std::tuple<scatter_tag<A>, T1, const int32_t*, T2> &node, const U& userdata) {
+            return tmp = right(std::get<3>(node), userdata);
+        }
+    };
+
+    template<typename T1, typename T2, typename U, typename model>
+    struct array_eval_t<std::tuple<storeu_tag, T1, T2>,U,model> {
+        typedef typename model::pack_type return_type;
+        return_type tmp;
+        T1 ptr;
+
+        array_eval_t<T2,U,model> right;
+
+        void prepare(const std::tuple<storeu_tag, T1, T2> &node) {
+            right.prepare(std::get<2>(node));
+            ptr = std::get<1>(node);
+        }
+        void load(const std::tuple<storeu_tag, T1, T2> &node, const U& userdata) {
+            right.load(std::get<2>(node), userdata);
+        }
+        void store(const std::tuple<storeu_tag, T1, T2> &node, const U& userdata) {
+            right.store(std::get<2>(node), userdata);
+            model::storeu(ptr, userdata, tmp);
+        }
+        void finish(const std::tuple<storeu_tag, T1, T2> &node) {
+            right.finish(std::get<2>(node));
+        }
+        return_type operator()(const std::tuple<storeu_tag, T1, T2> &node, const U& userdata) {
+            return tmp = right(std::get<2>(node), userdata);
+        }
+    };
+
+    template<typename T1, typename T2, typename U, typename model>
+    struct array_eval_t<std::tuple<stream_tag, T1, T2>,U,model> {
+        typedef typename model::pack_type return_type;
+        return_type tmp;
+        T1 ptr;
+
+        array_eval_t<T2,U,model> right;
+
+        void prepare(const std::tuple<stream_tag, T1, T2> &node) {
+            right.prepare(std::get<2>(node));
+            ptr = std::get<1>(node);
+        }
+        void load(const std::tuple<stream_tag, T1, T2> &node, const U& userdata) {
+            right.load(std::get<2>(node), userdata);
+        }
+        void store(const std::tuple<stream_tag, T1, T2> &node, const U& userdata) {
+            right.store(std::get<2>(node), userdata);
+            model::stream(ptr, userdata, tmp);
+        }
+        void finish(const std::tuple<stream_tag, T1, T2> &node) {
+            right.finish(std::get<2>(node));
+            model::fence();
+        }
+        return_type operator()(const std::tuple<stream_tag, T1, T2> &node, const U& userdata) {
+            return tmp = right(std::get<2>(node), userdata);
+        }
+    };
 
     template<typename tag, typename T1, typename U, typename model>
     struct array_eval_t<std::tuple<tag, T1>,U,model> {
@@ -357,6 +1466,9 @@ namespace arrr {
         void store(const std::tuple<tag, T1> &node, const U& userdata) {
             child.store(std::get<1>(node), userdata);
         }
+        void finish(const std::tuple<tag, T1> &node) {
+            child.finish(std::get<1>(node));
+        }
         return_type operator()(const std::tuple<tag, T1> &node, const U& userdata) {
             return model::template unary<tag>(
                 child(std::get<1>(node), userdata)
@@ -364,6 +1476,28 @@ namespace arrr {
         }
     };
 
+    template<int N, typename T1, typename U, typename model>
+    struct array_eval_t<std::tuple<unroll_tag<N>, T1>,U,model> {
+        array_eval_t<T1,U,model> child;
+
+        void prepare(const std::tuple<unroll_tag<N>, T1> &node) {
+            child.prepare(std::get<1>(node));
+        }
+        void load(const std::tuple<unroll_tag<N>, T1> &node, const U& userdata) {
+            child.load(std::get<1>(node), userdata);
+        }
+        void store(const std::tuple<unroll_tag<N>, T1> &node, const U& userdata) {
+            child.store(std::get<1>(node), userdata);
+        }
+        void finish(const std::tuple<unroll_tag<N>, T1> &node) {
+            child.finish(std::get<1>(node));
+        }
+        auto operator()(const std::tuple<unroll_tag<N>, T1> &node, const U& userdata)
+        -> decltype(child(std::get<1>(node), userdata)) {
+            return child(std::get<1>(node), userdata);
+        }
+    };
+
     template<typename tag, typename T1, typename T2, typename U, typename model>
     struct array_eval_t<std::tuple<tag, T1, T2>,U,model> {
         typedef typename model::pack_type return_type;
@@ -382,6 +1516,10 @@ namespace arrr {
             left.store(std::get<1>(node), userdata);
             right.store(std::get<2>(node), userdata);
         }
+        void finish(const std::tuple<tag, T1, T2> &node) {
+            left.finish(std::get<1>(node));
+            right.finish(std::get<2>(node));
+        }
         return_type operator()(const std::tuple<tag, T1, T2> &node, const U& userdata) {
             return model::template binary<tag>(
                 left(std::get<1>(node), userdata),
@@ -389,6 +1527,780 @@ namespace arrr {
             );
         }
     };
+
+    template<typename tag, typename T1, typename T2, typename T3, typename U, typename model>
+    struct array_eval_t<std::tuple<tag, T1, T2, T3>,U,model> {
+        typedef typename model::pack_type return_type;
+        array_eval_t<T1,U,model> first;
+        array_eval_t<T2,U,model> second;
+        array_eval_t<T3,U,model> third;
+
+        void prepare(const std::tuple<tag, T1, T2, T3> &node) {
+            first.prepare(std::get<1>(node));
+            second.prepare(std::get<2>(node));
+            third.prepare(std::get<3>(node));
+        }
+        void load(const std::tuple<tag, T1, T2, T3> &node, const U& userdata) {
+            first.load(std::get<1>(node), userdata);
+            second.load(std::get<2>(node), userdata);
+            third.load(std::get<3>(node), userdata);
+        }
+        void store(const std::tuple<tag, T1, T2, T3> &node, const U& userdata) {
+            first.store(std::get<1>(node), userdata);
+            second.store(std::get<2>(node), userdata);
+            third.store(std::get<3>(node), userdata);
+        }
+        void finish(const std::tuple<tag, T1, T2, T3> &node) {
+            first.finish(std::get<1>(node));
+            second.finish(std::get<2>(node));
+            third.finish(std::get<3>(node));
+        }
+        return_type operator()(const std::tuple<tag, T1, T2, T3> &node, const U& userdata) {
+            return model::template ternary<tag>(
+                first(std::get<1>(node), userdata),
+                second(std::get<2>(node), userdata),
+                third(std::get<3>(node), userdata)
+            );
+        }
+    };
+
+    // Sums and differences with a product operand are contracted into a
+    // single fused ternary operation. contraction describes where the three
+    // operands live in the original binary node.
+    template<typename T>
+    struct contraction;
+
+    template<typename T1, typename T2, typename T3>
+    struct contraction<std::tuple<add_tag, std::tuple<mul_tag, T1, T2>, T3>> {
+        typedef std::tuple<add_tag, std::tuple<mul_tag, T1, T2>, T3> node_type;
+        typedef fma_tag tag;
+        typedef T1 first_type;
+        typedef T2 second_type;
+        typedef T3 third_type;
+        static const T1& first(const node_type &node) { return std::get<1>(std::get<1>(node)); }
+        static const T2& second(const node_type &node) { return std::get<2>(std::get<1>(node)); }
+        static const T3& third(const node_type &node) { return std::get<2>(node); }
+    };
+
+    template<typename T1, typename T2, typename T3>
+    struct contraction<std::tuple<add_tag, T3, std::tuple<mul_tag, T1, T2>>> {
+        typedef std::tuple<add_tag, T3, std::tuple<mul_tag, T1, T2>> node_type;
+        typedef fma_tag tag;
+        typedef T1 first_type;
+        typedef T2 second_type;
+        typedef T3 third_type;
+        static const T1& first(const node_type &node) { return std::get<1>(std::get<2>(node)); }
+        static const T2& second(const node_type &node) { return std::get<2>(std::get<2>(node)); }
+        static const T3& third(const node_type &node) { return std::get<1>(node); }
+    };
+
+    template<typename T1, typename T2, typename T3>
+    struct contraction<std::tuple<sub_tag, std::tuple<mul_tag, T1, T2>, T3>> {
+        typedef std::tuple<sub_tag, std::tuple<mul_tag, T1, T2>, T3> node_type;
+        typedef fms_tag tag;
+        typedef T1 first_type;
+        typedef T2 second_type;
+        typedef T3 third_type;
+        static const T1& first(const node_type &node) { return std::get<1>(std::get<1>(node)); }
+        static const T2& second(const node_type &node) { return std::get<2>(std::get<1>(node)); }
+        static const T3& third(const node_type &node) { return std::get<2>(node); }
+    };
+
+    template<typename T1, typename T2, typename T3>
+    struct contraction<std::tuple<sub_tag, T3, std::tuple<mul_tag, T1, T2>>> {
+        typedef std::tuple<sub_tag, T3, std::tuple<mul_tag, T1, T2>> node_type;
+        typedef fnma_tag tag;
+        typedef T1 first_type;
+        typedef T2 second_type;
+        typedef T3 third_type;
+        static const T1& first(const node_type &node) { return std::get<1>(std::get<2>(node)); }
+        static const T2& second(const node_type &node) { return std::get<2>(std::get<2>(node)); }
+        static const T3& third(const node_type &node) { return std::get<1>(node); }
+    };
+
+    // a*b+c*d and a*b-c*d match both sides, contract the left product.
+    template<typename T1, typename T2, typename T3, typename T4>
+    struct contraction<std::tuple<add_tag, std::tuple<mul_tag, T1, T2>, std::tuple<mul_tag, T3, T4>>> {
+        typedef std::tuple<add_tag, std::tuple<mul_tag, T1, T2>, std::tuple<mul_tag, T3, T4>> node_type;
+        typedef fma_tag tag;
+        typedef T1 first_type;
+        typedef T2 second_type;
+        typedef std::tuple<mul_tag, T3, T4> third_type;
+        static const T1& first(const node_type &node) { return std::get<1>(std::get<1>(node)); }
+        static const T2& second(const node_type &node) { return std::get<2>(std::get<1>(node)); }
+        static const third_type& third(const node_type &node) { return std::get<2>(node); }
+    };
+
+    template<typename T1, typename T2, typename T3, typename T4>
+    struct contraction<std::tuple<sub_tag, std::tuple<mul_tag, T1, T2>, std::tuple<mul_tag, T3, T4>>> {
+        typedef std::tuple<sub_tag, std::tuple<mul_tag, T1, T2>, std::tuple<mul_tag, T3, T4>> node_type;
+        typedef fms_tag tag;
+        typedef T1 first_type;
+        typedef T2 second_type;
+        typedef std::tuple<mul_tag, T3, T4> third_type;
+        static const T1& first(const node_type &node) { return std::get<1>(std::get<1>(node)); }
+        static const T2& second(const node_type &node) { return std::get<2>(std::get<1>(node)); }
+        static const third_type& third(const node_type &node) { return std::get<2>(node); }
+    };
+
+    template<typename T, typename U, typename model>
+    struct contracted_eval_t {
+        typedef typename model::pack_type return_type;
+        typedef contraction<T> traits;
+        array_eval_t<typename traits::first_type,U,model> first;
+        array_eval_t<typename traits::second_type,U,model> second;
+        array_eval_t<typename traits::third_type,U,model> third;
+
+        void prepare(const T &node) {
+            first.prepare(traits::first(node));
+            second.prepare(traits::second(node));
+            third.prepare(traits::third(node));
+        }
+        void load(const T &node, const U& userdata) {
+            first.load(traits::first(node), userdata);
+            second.load(traits::second(node), userdata);
+            third.load(traits::third(node), userdata);
+        }
+        void store(const T &node, const U& userdata) {
+            first.store(traits::first(node), userdata);
+            second.store(traits::second(node), userdata);
+            third.store(traits::third(node), userdata);
+        }
+        void finish(const T &node) {
+            first.finish(traits::first(node));
+            second.finish(traits::second(node));
+            third.finish(traits::third(node));
+        }
+        return_type operator()(const T &node, const U& userdata) {
+            return model::template ternary<typename traits::tag>(
+                first(traits::first(node), userdata),
+                second(traits::second(node), userdata),
+                third(traits::third(node), userdata)
+            );
+        }
+    };
+
+    template<typename T1, typename T2, typename T3, typename U, typename model>
+    struct array_eval_t<std::tuple<add_tag, std::tuple<mul_tag, T1, T2>, T3>,U,model>
+    : contracted_eval_t<std::tuple<add_tag, std::tuple<mul_tag, T1, T2>, T3>,U,model> { };
+
+    template<typename T1, typename T2, typename T3, typename U, typename model>
+    struct array_eval_t<std::tuple<add_tag, T3, std::tuple<mul_tag, T1, T2>>,U,model>
+    : contracted_eval_t<std::tuple<add_tag, T3, std::tuple<mul_tag, T1, T2>>,U,model> { };
+
+    template<typename T1, typename T2, typename T3, typename U, typename model>
+    struct array_eval_t<std::tuple<sub_tag, std::tuple<mul_tag, T1, T2>, T3>,U,model>
+    : contracted_eval_t<std::tuple<sub_tag, std::tuple<mul_tag, T1, T2>, T3>,U,model> { };
+
+    template<typename T1, typename T2, typename T3, typename U, typename model>
+    struct array_eval_t<std::tuple<sub_tag, T3, std::tuple<mul_tag, T1, T2>>,U,model>
+    : contracted_eval_t<std::tuple<sub_tag, T3, std::tuple<mul_tag, T1, T2>>,U,model> { };
+
+    template<typename T1, typename T2, typename T3, typename T4, typename U, typename model>
+    struct array_eval_t<std::tuple<add_tag, std::tuple<mul_tag, T1, T2>, std::tuple<mul_tag, T3, T4>>,U,model>
+    : contracted_eval_t<std::tuple<add_tag, std::tuple<mul_tag, T1, T2>, std::tuple<mul_tag, T3, T4>>,U,model> { };
+
+    template<typename T1, typename T2, typename T3, typename T4, typename U, typename model>
+    struct array_eval_t<std::tuple<sub_tag, std::tuple<mul_tag, T1, T2>, std::tuple<mul_tag, T3, T4>>,U,model>
+    : contracted_eval_t<std::tuple<sub_tag, std::tuple<mul_tag, T1, T2>, std::tuple<mul_tag, T3, T4>>,U,model> { };
+    template<typename tag, typename T1, typename T2, typename U, typename model>
+    struct array_eval_t<std::tuple<reduce_tag<tag>, T1*, T2>,U,model> {
+        typedef typename model::pack_type return_type;
+        return_type acc;
+        T1 *ptr;
+
+        array_eval_t<T2,U,model> right;
+
+        void prepare(const std::tuple<reduce_tag<tag>, T1*, T2> &node) {
+            right.prepare(std::get<2>(node));
+            ptr = std::get<1>(node);
+            acc = model::set(reduce_identity<tag, typename model::value_type>::value());
+        }
+        void load(const std::tuple<reduce_tag<tag>, T1*, T2> &node, const U& userdata) {
+            right.load(std::get<2>(node), userdata);
+        }
+        void store(const std::tuple<reduce_tag<tag>, T1*, T2> &node, const U& userdata) {
+            right.store(std::get<2>(node), userdata);
+        }
+        void finish(const std::tuple<reduce_tag<tag>, T1*, T2> &node) {
+            right.finish(std::get<2>(node));
+            std::lock_guard<std::mutex> lock(reduction_mutex());
+            *ptr = scalar_instruction_set<T1>::template binary<tag>(*ptr, model::template reduce<tag>(acc));
+        }
+        return_type operator()(const std::tuple<reduce_tag<tag>, T1*, T2> &node, const U& userdata) {
+            // lanes outside a masked tail must not contribute to the result
+            const return_type value = model::blend_tail(
+                right(std::get<2>(node), userdata),
+                model::set(reduce_identity<tag, typename model::value_type>::value()),
+                userdata
+            );
+            return acc = model::template binary<tag>(acc, value);
+        }
+    };
+
+    // fused_eval_t evaluates the statements of a fuse node from index I on.
+    template<size_t I, typename U, typename model, typename... Ts>
+    struct fused_eval_t {
+        template<typename N> void prepare(const N &) { }
+        template<typename N> void load(const N &, const U&) { }
+        template<typename N> void store(const N &, const U&) { }
+        template<typename N> void finish(const N &) { }
+        template<typename N> void operator()(const N &, const U&) { }
+    };
+
+    template<size_t I, typename U, typename model, typename T, typename... Ts>
+    struct fused_eval_t<I,U,model,T,Ts...> {
+        array_eval_t<T,U,model> head;
+        fused_eval_t<I+1,U,model,Ts...> tail;
+
+        template<typename N>
+        void prepare(const N &node) {
+            head.prepare(std::get<I>(node));
+            tail.prepare(node);
+        }
+        template<typename N>
+        void load(const N &node, const U& userdata) {
+            head.load(std::get<I>(node), userdata);
+            tail.load(node, userdata);
+        }
+        template<typename N>
+        void store(const N &node, const U& userdata) {
+            head.store(std::get<I>(node), userdata);
+            tail.store(node, userdata);
+        }
+        template<typename N>
+        void finish(const N &node) {
+            head.finish(std::get<I>(node));
+            tail.finish(node);
+        }
+        template<typename N>
+        void operator()(const N &node, const U& userdata) {
+            head(std::get<I>(node), userdata);
+            tail(node, userdata);
+        }
+    };
+
+    template<typename... Ts, typename U, typename model>
+    struct array_eval_t<std::tuple<fuse_tag, std::tuple<Ts...>>,U,model> {
+        fused_eval_t<0,U,model,Ts...> statements;
+
+        void prepare(const std::tuple<fuse_tag, std::tuple<Ts...>> &node) {
+            statements.prepare(std::get<1>(node));
+        }
+        void load(const std::tuple<fuse_tag, std::tuple<Ts...>> &node, const U& userdata) {
+            statements.load(std::get<1>(node), userdata);
+        }
+        void store(const std::tuple<fuse_tag, std::tuple<Ts...>> &node, const U& userdata) {
+            statements.store(std::get<1>(node), userdata);
+        }
+        void finish(const std::tuple<fuse_tag, std::tuple<Ts...>> &node) {
+            statements.finish(std::get<1>(node));
+        }
+        void operator()(const std::tuple<fuse_tag, std::tuple<Ts...>> &node, const U& userdata) {
+            statements(std::get<1>(node), userdata);
+        }
+    };
+
+    // shared_loads finds arrays that a statement reads more than once, as x
+    // in x*x + y*x. Every repetition is replaced by a shared_source that
+    // returns the pack loaded for the first occurrence, so each distinct
+    // array is loaded once per iteration and count<>, and with it the unroll
+    // factor, only sees the distinct loads. Repetitions are only known from
+    // the addresses at runtime, so a loop is compiled for every possible
+    // pattern of repetitions among the first ARRR_SHARED_LOADS arrays (5 for
+    // three arrays of the same type, 15 for four) and the matching one runs.
+    // Defining ARRR_SHARED_LOADS as 0 turns the detection off.
+#if !defined(ARRR_SHARED_LOADS)
+    #define ARRR_SHARED_LOADS 3
+#endif
+
+    template<typename T>
+    struct is_source {
+        static const bool value = false;
+    };
+    template<typename T1, size_t N>
+    struct is_source<const arithmetic_array<T1,N>&> {
+        static const bool value = true;
+    };
+    template<typename T1>
+    struct is_source<array_view<T1>> {
+        static const bool value = true;
+    };
+
+    template<typename T1>
+    struct is_source<strided_view<T1>> {
+        static const bool value = true;
+    };
+
+    // same_source tells whether two arrays of the same type read the same
+    // elements
+    template<typename A>
+    bool same_source(const A &a, const A &b) {
+        return static_cast<const void*>(a.data()) == static_cast<const void*>(b.data());
+    }
+    template<typename T1>
+    bool same_source(const strided_view<T1> &a, const strided_view<T1> &b) {
+        return a.data() == b.data() && a.stride() == b.stride();
+    }
+
+    template<typename T>
+    struct source_count {
+        static const size_t value = is_source<T>::value ? 1 : 0;
+    };
+    template<>
+    struct source_count<std::tuple<>> {
+        static const size_t value = 0;
+    };
+    template<typename T, typename... Ts>
+    struct source_count<std::tuple<T, Ts...>> {
+        static const size_t value = source_count<T>::value + source_count<std::tuple<Ts...>>::value;
+    };
+
+    // shared_source<S> reads the S-th distinct array of a shared node
+    template<size_t S>
+    struct shared_source { };
+
+    template<size_t S>
+    struct count<shared_source<S>> {
+        static const int loads = 0;
+        static const int stores = 0;
+        static const int operations = 0;
+        static const int immediates = 0;
+    };
+
+    // shared nodes hold the distinct arrays of a statement and the statement
+    // with all of its arrays replaced by shared_sources
+    struct shared_tag { };
+    template<typename... Ts, typename T1>
+    struct is_node<std::tuple<shared_tag, std::tuple<Ts...>, T1>> {
+        static const bool value = true;
+    };
+
+    template<typename... Ts, typename T1>
+    struct count<std::tuple<shared_tag, std::tuple<Ts...>, T1>> {
+        typedef count<std::tuple<fuse_tag, std::tuple<Ts...>>> sources;
+        static const int loads = sources::loads + count<T1>::loads;
+        static const int stores = count<T1>::stores;
+        static const int operations = count<T1>::operations;
+        static const int immediates = count<T1>::immediates;
+    };
+
+    // the distinct arrays stay live for the whole root, the shared_sources
+    // in the statement need no register of their own
+    template<typename... Ts, typename T1>
+    struct register_need<std::tuple<shared_tag, std::tuple<Ts...>, T1>> {
+        static const int value = int(sizeof...(Ts)) + register_need<T1>::value;
+    };
+
+    // shared_index is the userdata below a shared node. It converts to the
+    // loop index so stores and reductions work unchanged.
+    template<typename U, typename S>
+    struct shared_index {
+        const U &index;
+        S &sources;
+        shared_index(const U &index_, S &sources_) : index(index_), sources(sources_) { }
+        operator const U&() const { return index; }
+    };
+
+    template<size_t S>
+    struct shared_pack {
+        template<typename R, typename E>
+        static R get(const E &sources) { return shared_pack<S-1>::template get<R>(sources.tail); }
+    };
+    template<>
+    struct shared_pack<0> {
+        template<typename R, typename E>
+        static R get(const E &sources) { return sources.head.tmp; }
+    };
+
+    template<size_t S, typename U, typename E, typename model>
+    struct array_eval_t<shared_source<S>,shared_index<U,E>,model> {
+        typedef typename model::pack_type return_type;
+        void prepare(const shared_source<S> &) { }
+        void load(const shared_source<S> &, const shared_index<U,E> &) { }
+        void store(const shared_source<S> &, const shared_index<U,E> &) { }
+        void finish(const shared_source<S> &) { }
+        return_type operator()(const shared_source<S> &, const shared_index<U,E> &userdata) {
+            return shared_pack<S>::template get<return_type>(userdata.sources);
+        }
+    };
+
+    template<typename... Ts, typename T1, typename U, typename model>
+    struct array_eval_t<std::tuple<shared_tag, std::tuple<Ts...>, T1>,U,model> {
+        typedef fused_eval_t<0,U,model,Ts...> sources_type;
+        typedef shared_index<U,sources_type> index_type;
+        sources_type sources;
+        array_eval_t<T1,index_type,model> body;
+
+        void prepare(const std::tuple<shared_tag, std::tuple<Ts...>, T1> &node) {
+            sources.prepare(std::get<1>(node));
+            body.prepare(std::get<2>(node));
+        }
+        void load(const std::tuple<shared_tag, std::tuple<Ts...>, T1> &node, const U& userdata) {
+            sources.load(std::get<1>(node), userdata);
+            body.load(std::get<2>(node), index_type(userdata, sources));
+        }
+        void store(const std::tuple<shared_tag, std::tuple<Ts...>, T1> &node, const U& userdata) {
+            body.store(std::get<2>(node), index_type(userdata, sources));
+        }
+        void finish(const std::tuple<shared_tag, std::tuple<Ts...>, T1> &node) {
+            sources.finish(std::get<1>(node));
+            body.finish(std::get<2>(node));
+        }
+        void operator()(const std::tuple<shared_tag, std::tuple<Ts...>, T1> &node, const U& userdata) {
+            body(std::get<2>(node), index_type(userdata, sources));
+        }
+    };
+
+    // a shared_pattern lists the slot of every array of a statement in the
+    // order they appear. Slots are numbered by first occurrence.
+    template<size_t... S>
+    struct shared_pattern { };
+
+    template<typename P, size_t S>
+    struct shared_append;
+    template<size_t... Ss, size_t S>
+    struct shared_append<shared_pattern<Ss...>, S> {
+        typedef shared_pattern<Ss..., S> type;
+    };
+
+    template<size_t I, typename P>
+    struct shared_at;
+    template<size_t I, size_t S, size_t... Ss>
+    struct shared_at<I, shared_pattern<S, Ss...>> {
+        static const size_t value = shared_at<I-1, shared_pattern<Ss...>>::value;
+    };
+    template<size_t S, size_t... Ss>
+    struct shared_at<0, shared_pattern<S, Ss...>> {
+        static const size_t value = S;
+    };
+
+    template<size_t N>
+    struct shared_sequence {
+        typedef typename shared_append<typename shared_sequence<N-1>::type, N-1>::type type;
+    };
+    template<>
+    struct shared_sequence<0> {
+        typedef shared_pattern<> type;
+    };
+
+    // shared_rewrite<T,M,P> replaces the arrays in T by the slots at the
+    // front of P, M slots are taken already. body is the rewritten node,
+    // sources the arrays that open a new slot and rest what is left of P.
+    template<typename T, size_t M, typename P, typename Enable = void>
+    struct shared_rewrite {
+        typedef T body;
+        typedef std::tuple<> sources_type;
+        typedef P rest;
+        static const size_t slots = M;
+        static body rewrite(const typename std::remove_reference<T>::type &node) { return node; }
+        static sources_type sources(const typename std::remove_reference<T>::type &) { return sources_type(); }
+    };
+
+    template<typename T, size_t M, size_t S, size_t... Ss>
+    struct shared_rewrite<T, M, shared_pattern<S, Ss...>, typename std::enable_if<is_source<T>::value>::type> {
+        typedef typename std::remove_reference<T>::type node_type;
+        typedef shared_source<S> body;
+        typedef typename std::conditional<S == M, std::tuple<T>, std::tuple<>>::type sources_type;
+        typedef shared_pattern<Ss...> rest;
+        static const size_t slots = S == M ? M+1 : M;
+        static body rewrite(const node_type &) { return body(); }
+        static sources_type sources(const node_type &node) { return first(node, std::integral_constant<bool, S == M>()); }
+        static std::tuple<T> first(const node_type &node, std::true_type) { return std::tuple<T>(node); }
+        static std::tuple<> first(const node_type &, std::false_type) { return std::tuple<>(); }
+    };
+
+    template<size_t I, size_t M, typename P, typename T, typename Enable = void>
+    struct shared_rewrite_from {
+        typedef std::tuple<> body;
+        typedef std::tuple<> sources_type;
+        typedef P rest;
+        static const size_t slots = M;
+        static body rewrite(const T &) { return body(); }
+        static sources_type sources(const T &) { return sources_type(); }
+    };
+
+    template<size_t I, size_t M, typename P, typename... Cs>
+    struct shared_rewrite_from<I, M, P, std::tuple<Cs...>, typename std::enable_if<(I < sizeof...(Cs))>::type> {
+        typedef shared_rewrite<typename std::tuple_element<I, std::tuple<Cs...>>::type, M, P> head;
+        typedef shared_rewrite_from<I+1, head::slots, typename head::rest, std::tuple<Cs...>> tail;
+        typedef decltype(std::tuple_cat(std::declval<std::tuple<typename head::body>>(), std::declval<typename tail::body>())) body;
+        typedef decltype(std::tuple_cat(std::declval<typename head::sources_type>(), std::declval<typename tail::sources_type>())) sources_type;
+        typedef typename tail::rest rest;
+        static const size_t slots = tail::slots;
+        static body rewrite(const std::tuple<Cs...> &node) {
+            return std::tuple_cat(std::tuple<typename head::body>(head::rewrite(std::get<I>(node))), tail::rewrite(node));
+        }
+        static sources_type sources(const std::tuple<Cs...> &node) {
+            return std::tuple_cat(head::sources(std::get<I>(node)), tail::sources(node));
+        }
+    };
+
+    template<typename... Cs, size_t M, typename P>
+    struct shared_rewrite<std::tuple<Cs...>, M, P> : shared_rewrite_from<0, M, P, std::tuple<Cs...>> { };
+
+    // shared_dispatch assigns array K of a statement with L arrays to a slot
+    // by comparing its address with the first array of every slot of the
+    // same type (shared_match), and runs f on the rewritten statement once
+    // all arrays are assigned. leaders holds the index of the first array
+    // of every slot.
+    template<typename T1, size_t K, size_t L, typename leaders, typename P>
+    struct shared_dispatch;
+
+    template<typename T1, size_t K, size_t L, typename leaders, typename P, size_t M, typename Enable = void>
+    struct shared_match {
+        // M is past the last slot, K opens a new one
+        template<typename A, typename F>
+        static void run(const T1 &expr, const A &arrays, const F &f) {
+            shared_dispatch<T1, K+1, L, typename shared_append<leaders, K>::type, typename shared_append<P, M>::type>::run(expr, arrays, f);
+        }
+    };
+
+    template<typename T1, size_t K, size_t L, size_t... Is, typename P, size_t M>
+    struct shared_match<T1, K, L, shared_pattern<Is...>, P, M, typename std::enable_if<(M < sizeof...(Is))>::type> {
+        static const size_t leader = shared_at<M, shared_pattern<Is...>>::value;
+        typedef shared_match<T1, K, L, shared_pattern<Is...>, P, M+1> next;
+        template<typename A, typename F>
+        static void run(const T1 &expr, const A &arrays, const F &f) {
+            match(expr, arrays, f, std::is_same<typename std::tuple_element<K, A>::type, typename std::tuple_element<leader, A>::type>());
+        }
+        template<typename A, typename F>
+        static void match(const T1 &expr, const A &arrays, const F &f, std::true_type) {
+            if(same_source(std::get<K>(arrays), std::get<leader>(arrays)))
+                shared_dispatch<T1, K+1, L, shared_pattern<Is...>, typename shared_append<P, M>::type>::run(expr, arrays, f);
+            else
+                next::run(expr, arrays, f);
+        }
+        template<typename A, typename F>
+        static void match(const T1 &expr, const A &arrays, const F &f, std::false_type) {
+            next::run(expr, arrays, f);
+        }
+    };
+
+    template<typename T1, size_t K, size_t L, size_t... Is, typename P>
+    struct shared_dispatch<T1, K, L, shared_pattern<Is...>, P> {
+        // arrays past ARRR_SHARED_LOADS always open a new slot
+        typedef shared_match<T1, K, L, shared_pattern<Is...>, P, K < ARRR_SHARED_LOADS ? 0 : sizeof...(Is)> match;
+        template<typename A, typename F>
+        static void run(const T1 &expr, const A &arrays, const F &f) {
+            match::run(expr, arrays, f);
+        }
+    };
+
+    template<typename T1, size_t L, size_t... Is, typename P>
+    struct shared_dispatch<T1, L, L, shared_pattern<Is...>, P> {
+        typedef shared_rewrite<T1, 0, P> rewrite;
+        typedef std::tuple<shared_tag, typename rewrite::sources_type, typename rewrite::body> node_type;
+        template<typename A, typename F>
+        static void run(const T1 &expr, const A &, const F &f) {
+            apply(expr, f, std::integral_constant<bool, sizeof...(Is) == L>());
+        }
+        template<typename F>
+        static void apply(const T1 &expr, const F &f, std::true_type) {
+            f(expr);
+        }
+        template<typename F>
+        static void apply(const T1 &expr, const F &f, std::false_type) {
+            f(node_type(shared_tag(), rewrite::sources(expr), rewrite::rewrite(expr)));
+        }
+    };
+
+    template<typename T1>
+    struct shared_loads {
+        static const size_t arrays = source_count<T1>::value;
+        typedef shared_rewrite<T1, 0, typename shared_sequence<arrays>::type> all;
+        template<typename F>
+        static void run(const T1 &expr, const F &f) {
+            shared_dispatch<T1, 0, arrays, shared_pattern<>, shared_pattern<>>::run(expr, all::sources(expr), f);
+        }
+    };
+
+    // expression_traits finds the element type and runtime length of an
+    // expression from the arrays it references.
+    template<typename T>
+    struct expression_traits {
+        typedef void value_type;
+        static size_t size(const T &) { return 0; }
+    };
+
+    template<typename T1, size_t N>
+    struct expression_traits<const arithmetic_array<T1,N>&> {
+        typedef typename compute_type<T1>::type value_type;
+        static size_t size(const arithmetic_array<T1,N> &node) { return node.size(); }
+    };
+
+    template<typename T1>
+    struct expression_traits<indexed_view<T1>> {
+        typedef typename compute_type<typename indexed_view<T1>::value_type>::type value_type;
+        static size_t size(const indexed_view<T1> &node) { return node.size(); }
+    };
+
+    template<typename T1>
+    struct expression_traits<strided_view<T1>> {
+        typedef typename compute_type<typename strided_view<T1>::value_type>::type value_type;
+        static size_t size(const strided_view<T1> &node) { return node.size(); }
+    };
+
+    template<typename T1>
+    struct expression_traits<array_view<T1>> {
+        typedef typename compute_type<typename array_view<T1>::value_type>::type value_type;
+        static size_t size(const array_view<T1> &node) { return node.size(); }
+    };
+
+    template<typename tag, typename T1>
+    struct expression_traits<std::tuple<tag, T1>> {
+        typedef typename expression_traits<T1>::value_type value_type;
+        static size_t size(const std::tuple<tag, T1> &node) {
+            return expression_traits<T1>::size(std::get<1>(node));
+        }
+    };
+
+    template<typename tag, typename T1, typename T2>
+    struct expression_traits<std::tuple<tag, T1, T2>> {
+        typedef typename std::conditional<
+            std::is_void<typename expression_traits<T1>::value_type>::value,
+            typename expression_traits<T2>::value_type,
+            typename expression_traits<T1>::value_type
+        >::type value_type;
+        static size_t size(const std::tuple<tag, T1, T2> &node) {
+            return std::max(expression_traits<T1>::size(std::get<1>(node)), expression_traits<T2>::size(std::get<2>(node)));
+        }
+    };
+
+    template<typename tag, typename T1, typename T2, typename T3>
+    struct expression_traits<std::tuple<tag, T1, T2, T3>> {
+        typedef typename std::conditional<
+            std::is_void<typename expression_traits<T1>::value_type>::value,
+            typename expression_traits<std::tuple<tag, T2, T3>>::value_type,
+            typename expression_traits<T1>::value_type
+        >::type value_type;
+        static size_t size(const std::tuple<tag, T1, T2, T3> &node) {
+            return std::max(expression_traits<T1>::size(std::get<1>(node)), std::max(expression_traits<T2>::size(std::get<2>(node)), expression_traits<T3>::size(std::get<3>(node))));
+        }
+    };
+
+    // all statements of a fuse node have to agree on the element type, the
+    // length is the longest one any of them references
+    template<size_t I, typename... Ts>
+    struct fused_traits {
+        typedef void value_type;
+        template<typename N>
+        static size_t size(const N &) { return 0; }
+    };
+
+    template<size_t I, typename T, typename... Ts>
+    struct fused_traits<I,T,Ts...> {
+        typedef fused_traits<I+1,Ts...> rest;
+        typedef typename std::conditional<
+            std::is_void<typename expression_traits<T>::value_type>::value,
+            typename rest::value_type,
+            typename expression_traits<T>::value_type
+        >::type value_type;
+        static_assert(std::is_void<typename rest::value_type>::value || std::is_same<value_type, typename rest::value_type>::value,
+            "fused statements need the same element type");
+        template<typename N>
+        static size_t size(const N &statements) {
+            return std::max(expression_traits<T>::size(std::get<I>(statements)), rest::size(statements));
+        }
+    };
+
+    template<typename... Ts>
+    struct expression_traits<std::tuple<fuse_tag, std::tuple<Ts...>>> {
+        typedef typename fused_traits<0,Ts...>::value_type value_type;
+        static size_t size(const std::tuple<fuse_tag, std::tuple<Ts...>> &node) {
+            return fused_traits<0,Ts...>::size(std::get<1>(node));
+        }
+    };
+
+    template<typename tag, typename policy = serial_policy, typename T1>
+    typename std::enable_if<is_node<T1>::value, typename expression_traits<typename store_type<T1>::type>::value_type>::type
+    reduce(const T1 &expr) {
+        typedef expression_traits<typename store_type<T1>::type> traits;
+        typedef typename traits::value_type value_type;
+        value_type result = reduce_identity<tag, value_type>::value();
+        policy::template execute<vector_instruction_set<value_type>, scalar_instruction_set<value_type>>(reduce<tag>(&result, expr), traits::size(expr));
+        return result;
+    }
+
+    template<typename policy = serial_policy, typename T1>
+    typename std::enable_if<is_node<T1>::value, typename expression_traits<typename store_type<T1>::type>::value_type>::type
+    sum(const T1 &expr) { return reduce<add_tag, policy>(expr); }
+
+    template<typename policy = serial_policy, typename T1>
+    typename std::enable_if<is_node<T1>::value, typename expression_traits<typename store_type<T1>::type>::value_type>::type
+    minimum(const T1 &expr) { return reduce<min_tag, policy>(expr); }
+
+    template<typename policy = serial_policy, typename T1>
+    typename std::enable_if<is_node<T1>::value, typename expression_traits<typename store_type<T1>::type>::value_type>::type
+    maximum(const T1 &expr) { return reduce<max_tag, policy>(expr); }
+
+    template<typename policy = serial_policy, typename T1, typename T2>
+    auto dot(const T1 &a, const T2 &b) -> decltype(sum<policy>(a*b)) { return sum<policy>(a*b); }
+
+    template<typename policy = serial_policy, typename T1>
+    auto norm(const T1 &expr) -> decltype(sum<policy>(expr*expr)) { return std::sqrt(sum<policy>(expr*expr)); }
+
+    // evaluate runs a statement (store, storeu, stream, reduce or a fuse of
+    // them) over the length of the arrays it reads, e.g.
+    // evaluate(fuse(store(u.data(), a+b), store(v.data(), a-b)))
+    template<typename policy = serial_policy, typename T1>
+    typename std::enable_if<is_node<T1>::value, void>::type
+    evaluate(const T1 &statement) {
+        typedef expression_traits<T1> traits;
+        typedef typename traits::value_type value_type;
+        policy::template execute<vector_instruction_set<value_type>, scalar_instruction_set<value_type>>(statement, traits::size(statement));
+    }
+
+    // policy_reference forwards assignments to an array through an execution
+    // policy, so parallel(y) += a*x runs on the thread pool while y += a*x
+    // stays on the calling thread.
+    template<typename policy, typename A>
+    class policy_reference {
+    public:
+        explicit policy_reference(A &array) : array_(array) { }
+
+        template<typename T1>
+        policy_reference& operator=(const T1 &rhs) {
+            array_.template assign<policy>(rhs);
+            return *this;
+        }
+        template<typename T1>
+        policy_reference& operator+=(const T1 &rhs) {
+            array_.template update<policy>(array_ + rhs);
+            return *this;
+        }
+        template<typename T1>
+        policy_reference& operator-=(const T1 &rhs) {
+            array_.template update<policy>(array_ - rhs);
+            return *this;
+        }
+        template<typename T1>
+        policy_reference& operator*=(const T1 &rhs) {
+            array_.template update<policy>(array_ * rhs);
+            return *this;
+        }
+        template<typename T1>
+        policy_reference& operator/=(const T1 &rhs) {
+            array_.template update<policy>(array_ / rhs);
+            return *this;
+        }
+    private:
+        A &array_;
+    };
+
+    template<typename A>
+    policy_reference<parallel_policy, A> parallel(A &array) {
+        return policy_reference<parallel_policy, A>(array);
+    }
+
+#include "deferred.hpp"
+#include "grid.hpp"
+#include "soa.hpp"
+#include "complex.hpp"
+#include "cast.hpp"
+#include "mapped.hpp"
+
+    #undef ARRR_INLINE
     #undef ARRR_ALIGN
 }
 
@@ -0,0 +1,274 @@
+// bench measures ARRR against plain loops on working sets that fit into
+// each cache level and into main memory. Every row reports the arithmetic
+// intensity, the achieved bandwidth and arithmetic throughput and the
+// bandwidth as a percentage of the peak measured for that level, which
+// places the kernel on a roofline. --csv switches to machine-readable
+// output.
+#include "../arrr.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(__clang__)
+    #define BENCH_NOVECTOR
+    #define BENCH_NOVECTOR_LOOP _Pragma("clang loop vectorize(disable) interleave(disable)")
+#elif defined(__GNUC__)
+    #define BENCH_NOVECTOR __attribute__((optimize("no-tree-vectorize")))
+    #define BENCH_NOVECTOR_LOOP
+#else
+    #define BENCH_NOVECTOR
+    #define BENCH_NOVECTOR_LOOP
+#endif
+
+namespace bench {
+    enum level { l1, l2, l3, dram, levels };
+    const char *level_names[levels] = {"L1", "L2", "L3", "DRAM"};
+
+    inline size_t cache_size(int name, size_t fallback) {
+        long bytes = sysconf(name);
+        return bytes > 0 ? size_t(bytes) : fallback;
+    }
+
+    struct machine {
+        size_t cache[3];
+        double peak[levels];
+
+        machine() {
+            cache[l1] = cache_size(_SC_LEVEL1_DCACHE_SIZE, size_t(32)<<10);
+            cache[l2] = cache_size(_SC_LEVEL2_CACHE_SIZE, size_t(256)<<10);
+            cache[l3] = arrr::last_level_cache_size();
+            std::fill(peak, peak+levels, 0.0);
+        }
+
+        // half of a cache leaves room for the stack and the tables the
+        // vectorized math functions read. Main memory gets eight times the
+        // last level cache but at least 256MiB.
+        size_t working_set(level l) const {
+            if(l == dram)
+                return std::max(cache[l3]*8, size_t(256)<<20);
+            return cache[l]/2;
+        }
+
+        level classify(size_t bytes) const {
+            for(int l = l1; l < dram; ++l)
+                if(bytes <= cache[l])
+                    return level(l);
+            return dram;
+        }
+    };
+
+    // best_time returns the fastest of five samples in nanoseconds per call.
+    // A sample repeats f until it took at least 20ms.
+    template<typename F>
+    double best_time(F f) {
+        typedef std::chrono::steady_clock clock;
+        f();
+        size_t reps = 1;
+        for(;;) {
+            clock::time_point start = clock::now();
+            for(size_t k = 0; k < reps; ++k)
+                f();
+            if(clock::now()-start >= std::chrono::milliseconds(20) || reps >= (size_t(1)<<30))
+                break;
+            reps *= 2;
+        }
+        double best = 1e300;
+        for(int sample = 0; sample < 5; ++sample) {
+            clock::time_point start = clock::now();
+            for(size_t k = 0; k < reps; ++k)
+                f();
+            std::chrono::duration<double, std::nano> elapsed = clock::now()-start;
+            best = std::min(best, elapsed.count()/reps);
+        }
+        return best;
+    }
+
+    struct automatic {
+        static std::string name() { return "arrr"; }
+        template<typename T1>
+        static const T1& wrap(const T1 &expr) { return expr; }
+    };
+
+    template<int N>
+    struct pinned {
+        static std::string name() { return "arrr unroll<" + std::to_string(N) + ">"; }
+        template<typename T1>
+        static auto wrap(const T1 &expr) -> decltype(arrr::unroll<N>(expr)) { return arrr::unroll<N>(expr); }
+    };
+
+    // the kernels read x and y and write z (axpy updates y). element is the
+    // loop body of the plain loops, arrays is the number of arrays the
+    // working set is split into.
+    struct copy {
+        static const char* name() { return "copy"; }
+        static const int arrays = 2, bytes = 2, flops = 0;
+        template<typename W, typename A, typename T>
+        static void run(A &x, A &, A &z, T) { z = W::wrap(x); }
+        template<typename T>
+        static void element(const T *x, T *, T *z, T, size_t i) { z[i] = x[i]; }
+    };
+
+    struct axpy {
+        static const char* name() { return "axpy"; }
+        static const int arrays = 2, bytes = 3, flops = 2;
+        template<typename W, typename A, typename T>
+        static void run(A &x, A &y, A &, T s) { y = W::wrap(s*x + y); }
+        template<typename T>
+        static void element(const T *x, T *y, T *, T s, size_t i) { y[i] = s*x[i] + y[i]; }
+    };
+
+    struct triad {
+        static const char* name() { return "triad"; }
+        static const int arrays = 3, bytes = 3, flops = 2;
+        template<typename W, typename A, typename T>
+        static void run(A &x, A &y, A &z, T s) { z = W::wrap(x + s*y); }
+        template<typename T>
+        static void element(const T *x, T *y, T *z, T s, size_t i) { z[i] = x[i] + s*y[i]; }
+    };
+
+    struct hypot {
+        static const char* name() { return "sqrt(x*x+y*y)"; }
+        static const int arrays = 3, bytes = 3, flops = 4;
+        template<typename W, typename A, typename T>
+        static void run(A &x, A &y, A &z, T) { z = W::wrap(arrr::sqrt(x*x + y*y)); }
+        template<typename T>
+        static void element(const T *x, T *y, T *z, T, size_t i) { z[i] = std::sqrt(x[i]*x[i] + y[i]*y[i]); }
+    };
+
+    struct quotient {
+        static const char* name() { return "x/y+y/x"; }
+        static const int arrays = 3, bytes = 3, flops = 3;
+        template<typename W, typename A, typename T>
+        static void run(A &x, A &y, A &z, T) { z = W::wrap(x/y + y/x); }
+        template<typename T>
+        static void element(const T *x, T *y, T *z, T, size_t i) { z[i] = x[i]/y[i] + y[i]/x[i]; }
+    };
+
+    template<typename K, typename T>
+    void plain_loop(const T * __restrict x, T * __restrict y, T * __restrict z, T s, size_t n) {
+        for(size_t i = 0; i < n; ++i)
+            K::element(x, y, z, s, i);
+    }
+
+    template<typename K, typename T>
+    BENCH_NOVECTOR void scalar_loop(const T * __restrict x, T * __restrict y, T * __restrict z, T s, size_t n) {
+        BENCH_NOVECTOR_LOOP
+        for(size_t i = 0; i < n; ++i)
+            K::element(x, y, z, s, i);
+    }
+
+    struct report {
+        bool csv;
+
+        void header() const {
+            if(csv)
+                std::printf("type,kernel,variant,level,n,bytes,ns_per_element,flop_per_byte,gb_per_s,gflop_per_s,percent_of_peak\n");
+            else
+                std::printf("%-6s %-14s %-18s %-5s %10s %10s %9s %9s %9s %7s\n",
+                    "type", "kernel", "variant", "level", "n", "ns/elem", "flop/B", "GB/s", "GFLOP/s", "%peak");
+        }
+
+        void row(const machine &m, const char *type, const char *kernel, const std::string &variant,
+                 size_t n, size_t bytes_per_element, size_t flops_per_element, double ns) const {
+            const size_t bytes = n*bytes_per_element;
+            const level l = m.classify(bytes);
+            const double gbs = bytes/ns;
+            const double gflops = double(n)*flops_per_element/ns;
+            const double intensity = double(flops_per_element)/bytes_per_element;
+            const double percent = m.peak[l] > 0 ? 100*gbs/m.peak[l] : 0;
+            if(csv)
+                std::printf("%s,%s,%s,%s,%zu,%zu,%.4f,%.4f,%.3f,%.3f,%.1f\n",
+                    type, kernel, variant.c_str(), level_names[l], n, bytes, ns/n, intensity, gbs, gflops, percent);
+            else
+                std::printf("%-6s %-14s %-18s %-5s %10zu %10.4f %9.3f %9.2f %9.2f %7.1f\n",
+                    type, kernel, variant.c_str(), level_names[l], n, ns/n, intensity, gbs, gflops, percent);
+        }
+    };
+
+    template<typename T>
+    const char* type_name() { return sizeof(T) == 4 ? "float" : "double"; }
+
+    // measure_peak fills machine::peak with the best of memcpy, memset and
+    // a vectorized sum for every level. Kernels that mix reads and writes
+    // differently can still end up slightly above 100%.
+    template<typename T>
+    void measure_peak(machine &m) {
+        for(int l = l1; l < levels; ++l) {
+            const size_t n = m.working_set(level(l))/(2*sizeof(T));
+            arrr::arithmetic_array<T> x(n, T(1)), z(n);
+            const double copy_ns = best_time([&] { std::memcpy(z.data(), x.data(), n*sizeof(T)); });
+            const double fill_ns = best_time([&] { std::memset(z.data(), 0, n*sizeof(T)); });
+            volatile T sink;
+            const double read_ns = best_time([&] { sink = arrr::sum(x); });
+            const double best = std::max(2*n*sizeof(T)/copy_ns, n*sizeof(T)/std::min(fill_ns, read_ns));
+            m.peak[l] = std::max(m.peak[l], best);
+        }
+    }
+
+    template<typename T, typename K, typename W>
+    void run_arrr(const machine &m, const report &r, arrr::arithmetic_array<T> &x, arrr::arithmetic_array<T> &y,
+                  arrr::arithmetic_array<T> &z, size_t n) {
+        const T s = T(1)/T(1024);
+        const double ns = best_time([&] { K::template run<W>(x, y, z, s); });
+        r.row(m, type_name<T>(), K::name(), W::name(), n, K::bytes*sizeof(T), K::flops, ns);
+    }
+
+    template<typename T, typename K, int... unrolls>
+    void run_dynamic(const machine &m, const report &r, size_t n) {
+        arrr::arithmetic_array<T> x(n, T(1.5)), y(n, T(0.75)), z(n);
+        const T s = T(1)/T(1024);
+        r.row(m, type_name<T>(), K::name(), "loop", n, K::bytes*sizeof(T), K::flops,
+            best_time([&] { plain_loop<K>(x.data(), y.data(), z.data(), s, n); }));
+        r.row(m, type_name<T>(), K::name(), "loop novector", n, K::bytes*sizeof(T), K::flops,
+            best_time([&] { scalar_loop<K>(x.data(), y.data(), z.data(), s, n); }));
+        run_arrr<T, K, automatic>(m, r, x, y, z, n);
+        int expand[] = {(run_arrr<T, K, pinned<unrolls>>(m, r, x, y, z, n), 0)...};
+        (void)expand;
+    }
+
+    // statically sized arrays are only measured at two sizes since the
+    // length is part of the type.
+    template<typename T, typename K, size_t N>
+    void run_static(const machine &m, const report &r) {
+        static arrr::arithmetic_array<T,N> x(T(1.5)), y(T(0.75)), z;
+        const T s = T(1)/T(1024);
+        const double ns = best_time([&] { K::template run<automatic>(x, y, z, s); });
+        r.row(m, type_name<T>(), K::name(), "arrr static", N, K::bytes*sizeof(T), K::flops, ns);
+    }
+
+    template<typename T, typename K>
+    void run_kernel(const machine &m, const report &r) {
+        for(int l = l1; l < levels; ++l) {
+            const size_t n = m.working_set(level(l))/(K::arrays*sizeof(T))/64*64;
+            run_dynamic<T, K, 1, 2, 4, 8, 16>(m, r, n);
+        }
+        run_static<T, K, 1024>(m, r);
+        run_static<T, K, 32768>(m, r);
+    }
+
+    template<typename T>
+    void run_type(const machine &m, const report &r) {
+        run_kernel<T, copy>(m, r);
+        run_kernel<T, axpy>(m, r);
+        run_kernel<T, triad>(m, r);
+        run_kernel<T, hypot>(m, r);
+        run_kernel<T, quotient>(m, r);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench::report r = {argc > 1 && std::strcmp(argv[1], "--csv") == 0};
+    bench::machine m;
+    bench::measure_peak<float>(m);
+    if(!r.csv) {
+        std::printf("caches %zuKiB %zuKiB %zuKiB, peak", m.cache[bench::l1]>>10, m.cache[bench::l2]>>10, m.cache[bench::l3]>>10);
+        for(int l = bench::l1; l < bench::levels; ++l)
+            std::printf(" %s %.1fGB/s", bench::level_names[l], m.peak[l]);
+        std::printf("\n");
+    }
+    r.header();
+    bench::run_type<float>(m, r);
+    bench::run_type<double>(m, r);
+}
@@ -0,0 +1,316 @@
+
+// cast<T>(x) evaluates the expression x and converts its elements to T, as
+// in sum(cast<double>(x)) which accumulates a float array in double
+// precision without a double copy of it. Binary operations on expressions
+// of different element types cast both to the type of their sum (float and
+// double give double) and assignments cast to the element type of the
+// destination. Scalars are never promoted, 2.0*x stays a float expression.
+//
+// The loop steps by the packs of the statement. A cast evaluates its operand
+// in packs with the same number of elements: a double operand in a float
+// statement as two double packs per float pack, a float operand in a double
+// statement with the float packs of half the width. Masked tails convert
+// lane by lane.
+template<typename T>
+struct cast_tag { };
+
+template<typename T, typename T1>
+struct is_node<std::tuple<cast_tag<T>, T1>> {
+    static const bool value = true;
+};
+
+template<typename T, typename T1>
+struct store_type<std::tuple<cast_tag<T>, T1>> {
+    typedef std::tuple<cast_tag<T>, T1> type;
+};
+
+template<typename T, typename T1>
+struct expression_traits<std::tuple<cast_tag<T>, T1>> {
+    typedef T value_type;
+    static size_t size(const std::tuple<cast_tag<T>, T1> &node) {
+        return expression_traits<T1>::size(std::get<1>(node));
+    }
+};
+
+// cast_width is the number of packs the operand of a cast takes per pack
+// of the result
+template<typename T, typename T1>
+struct cast_width {
+    static const int value = sizeof(typename expression_traits<T1>::value_type) > sizeof(T) ? int(sizeof(typename expression_traits<T1>::value_type)/sizeof(T)) : 1;
+};
+
+template<typename T, typename T1>
+struct count<std::tuple<cast_tag<T>, T1>> {
+    static const int loads = count<T1>::loads*cast_width<T, T1>::value;
+    static const int stores = count<T1>::stores;
+    static const int operations = count<T1>::operations*cast_width<T, T1>::value + 1;
+    static const int immediates = count<T1>::immediates*cast_width<T, T1>::value;
+};
+
+template<typename T, typename T1>
+struct register_need<std::tuple<cast_tag<T>, T1>> {
+    static const int value = need_max(1, register_need<T1>::value*cast_width<T, T1>::value);
+};
+
+// the operand of a cast is evaluated with other packs than the statement,
+// so its arrays do not take part in shared loads
+template<typename T, typename T1>
+struct source_count<std::tuple<cast_tag<T>, T1>> {
+    static const size_t value = 0;
+};
+
+template<typename T, typename T1, size_t M, typename P>
+struct shared_rewrite<std::tuple<cast_tag<T>, T1>, M, P> {
+    typedef std::tuple<cast_tag<T>, T1> body;
+    typedef std::tuple<> sources_type;
+    typedef P rest;
+    static const size_t slots = M;
+    static body rewrite(const body &node) { return node; }
+    static sources_type sources(const body &) { return sources_type(); }
+};
+
+// converted<T, T1>::type is the expression T1 with elements of type T. It
+// is T1 itself if the elements already are T or T1 is a scalar.
+template<typename T, typename T1, typename Enable = void>
+struct converted {
+    typedef T1 type;
+    static type apply(const typename std::remove_reference<T1>::type &node) { return node; }
+};
+
+template<typename T, typename T1>
+struct converted<T, T1, typename std::enable_if<!std::is_void<typename expression_traits<T1>::value_type>::value && !std::is_same<typename expression_traits<T1>::value_type, T>::value>::type> {
+    typedef std::tuple<cast_tag<T>, T1> type;
+    static type apply(const typename std::remove_reference<T1>::type &node) { return type(cast_tag<T>(), node); }
+};
+
+template<typename T, typename T1>
+typename std::enable_if<is_node<T1>::value, typename converted<T, typename store_type<T1>::type>::type>::type
+cast(const T1 &a) {
+    static_assert(std::is_arithmetic<T>::value, "cast needs an arithmetic element type");
+    return converted<T, typename store_type<T1>::type>::apply(a);
+}
+
+template<typename T, typename T1>
+typename std::enable_if<std::is_arithmetic<T1>::value, T>::type
+cast(T1 a) {
+    return T(a);
+}
+
+// promotes<tag> tells whether a binary operation converts operands of
+// different element types. Masks would not survive the conversion, so &&
+// and || do not.
+template<typename tag>
+struct promotes {
+    static const bool value = true;
+};
+template<> struct promotes<and_tag> { static const bool value = false; };
+template<> struct promotes<or_tag> { static const bool value = false; };
+
+template<typename tag, typename T1, typename T2, typename Enable>
+struct promoted_binary {
+    typedef std::tuple<tag, T1, T2> type;
+    static type apply(const typename std::remove_reference<T1>::type &a, const typename std::remove_reference<T2>::type &b) {
+        return type(tag(), a, b);
+    }
+};
+
+template<typename tag, typename T1, typename T2>
+struct promoted_binary<tag, T1, T2, typename std::enable_if<promotes<tag>::value
+    && !std::is_void<typename expression_traits<T1>::value_type>::value
+    && !std::is_void<typename expression_traits<T2>::value_type>::value
+    && !std::is_same<typename expression_traits<T1>::value_type, typename expression_traits<T2>::value_type>::value>::type> {
+    typedef decltype(std::declval<typename expression_traits<T1>::value_type>() + std::declval<typename expression_traits<T2>::value_type>()) value_type;
+    typedef converted<value_type, T1> first;
+    typedef converted<value_type, T2> second;
+    typedef std::tuple<tag, typename first::type, typename second::type> type;
+    static type apply(const typename std::remove_reference<T1>::type &a, const typename std::remove_reference<T2>::type &b) {
+        return type(tag(), first::apply(a), second::apply(b));
+    }
+};
+
+template<typename P, typename T, typename Enable>
+struct stored : converted<typename compute_type<typename std::remove_cv<typename std::remove_pointer<P>::type>::type>::type, T> { };
+
+// paired_instruction_set works on two packs of the instruction set M at
+// once. It gives a cast operand as many lanes as the packs of the statement
+// if M alone has fewer.
+template<typename M>
+struct paired_instruction_set {
+    typedef typename M::value_type value_type;
+    struct pack_type { typename M::pack_type lo, hi; };
+    static const size_t pack_size = 2*M::pack_size;
+    static const size_t alignment = M::alignment;
+    static const size_t registers = M::registers;
+    static const bool masked_tail = false;
+
+    ARRR_INLINE static pack_type pair(typename M::pack_type lo, typename M::pack_type hi) { pack_type p = { lo, hi }; return p; }
+
+    template<typename T2>
+    ARRR_INLINE static pack_type set(T2 value) { return pair(M::set(value), M::set(value)); }
+    template<typename S>
+    ARRR_INLINE static pack_type load(const S *ptr, size_t index) { return pair(M::load(ptr, index), M::load(ptr, index+M::pack_size)); }
+    template<typename S>
+    ARRR_INLINE static pack_type loadu(const S *ptr, size_t index) { return pair(M::loadu(ptr, index), M::loadu(ptr, index+M::pack_size)); }
+    ARRR_INLINE static pack_type storeu(value_type *ptr, size_t index, pack_type val) { M::storeu(ptr, index, val.lo); M::storeu(ptr, index+M::pack_size, val.hi); return val; }
+    ARRR_INLINE static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return pair(M::gather(base, indices, index), M::gather(base, indices, index+M::pack_size)); }
+    ARRR_INLINE static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return pair(M::load_strided(ptr, index, stride), M::load_strided(ptr, index+M::pack_size, stride)); }
+
+    template<class tag>
+    ARRR_INLINE static pack_type unary(pack_type a) { return pair(M::template unary<tag>(a.lo), M::template unary<tag>(a.hi)); }
+    template<class tag>
+    ARRR_INLINE static pack_type binary(pack_type a, pack_type b) { return pair(M::template binary<tag>(a.lo, b.lo), M::template binary<tag>(a.hi, b.hi)); }
+    template<class tag>
+    ARRR_INLINE static pack_type ternary(pack_type a, pack_type b, pack_type c) { return pair(M::template ternary<tag>(a.lo, b.lo, c.lo), M::template ternary<tag>(a.hi, b.hi, c.hi)); }
+};
+
+// level_model<M, V>::type is the instruction set for elements of type V of
+// the same level as M and narrower_model<M>::type the one with half as
+// many lanes.
+template<typename M, typename V>
+struct level_model;
+
+template<typename M>
+struct narrower_model;
+
+template<typename T, typename V>
+struct level_model<scalar_instruction_set<T>, V> {
+    typedef scalar_instruction_set<V> type;
+};
+
+template<typename M, typename V>
+struct level_model<paired_instruction_set<M>, V> : level_model<M, V> { };
+
+#if defined(ARRR_DISPATCH) || defined(__SSE2__)
+template<typename T, typename V>
+struct level_model<sse2::instruction_set<T>, V> {
+    typedef sse2::instruction_set<V> type;
+};
+
+template<typename T>
+struct narrower_model<sse2::instruction_set<T>> {
+    typedef scalar_instruction_set<T> type;
+};
+#endif
+
+#if defined(ARRR_DISPATCH) || defined(__AVX__)
+template<typename T, typename V>
+struct level_model<avx::instruction_set<T>, V> {
+    typedef avx::instruction_set<V> type;
+};
+
+template<typename T>
+struct narrower_model<avx::instruction_set<T>> {
+    typedef sse2::instruction_set<T> type;
+};
+#endif
+
+#if defined(ARRR_DISPATCH) || defined(__AVX2__)
+template<typename T, typename V>
+struct level_model<avx2::instruction_set<T>, V> {
+    typedef avx2::instruction_set<V> type;
+};
+
+template<typename T>
+struct narrower_model<avx2::instruction_set<T>> {
+    typedef sse2::instruction_set<T> type;
+};
+#endif
+
+#if defined(ARRR_DISPATCH) || defined(__AVX512F__)
+template<typename T, typename V>
+struct level_model<avx512::instruction_set<T>, V> {
+    typedef avx512::instruction_set<V> type;
+};
+
+template<typename T>
+struct narrower_model<avx512::instruction_set<T>> {
+    typedef avx2::instruction_set<T> type;
+};
+#endif
+
+// lanes_model<M, P>::type has P lanes: M itself, a narrower instruction set
+// of the same level or pairs of them
+template<typename M, size_t P, int order = (M::pack_size > P) - (M::pack_size < P)>
+struct lanes_model : lanes_model<typename narrower_model<M>::type, P> { };
+
+template<typename M, size_t P>
+struct lanes_model<M, P, 0> {
+    typedef M type;
+};
+
+template<typename M, size_t P>
+struct lanes_model<M, P, -1> {
+    typedef paired_instruction_set<typename lanes_model<M, P/2>::type> type;
+};
+
+// cast_convert<M, L>::apply converts a pack of L to a pack of M with the
+// same number of lanes. The instruction sets provide convert functions for
+// float and double, everything else goes through memory.
+template<typename M, typename L, typename Enable = void>
+struct cast_convert {
+    ARRR_INLINE static typename M::pack_type apply(const typename L::pack_type &a) {
+        typename L::value_type in[M::pack_size];
+        typename M::value_type out[M::pack_size];
+        L::storeu(in, size_t(0), a);
+        for(size_t k = 0;k<M::pack_size;++k)
+            out[k] = typename M::value_type(in[k]);
+        return M::loadu(out, size_t(0));
+    }
+};
+
+template<typename M, typename L>
+struct cast_convert<M, L, decltype(void(M::convert(std::declval<typename L::pack_type>())))> {
+    ARRR_INLINE static typename M::pack_type apply(const typename L::pack_type &a) { return M::convert(a); }
+};
+
+template<typename M, typename L>
+struct cast_convert<M, paired_instruction_set<L>, decltype(void(M::convert(std::declval<typename L::pack_type>(), std::declval<typename L::pack_type>())))> {
+    ARRR_INLINE static typename M::pack_type apply(const typename paired_instruction_set<L>::pack_type &a) { return M::convert(a.lo, a.hi); }
+};
+
+template<typename T, typename T1, typename U, typename model>
+struct array_eval_t<std::tuple<cast_tag<T>, T1>,U,model> {
+    typedef typename model::pack_type return_type;
+    typedef typename expression_traits<T1>::value_type source_type;
+    typedef typename lanes_model<typename level_model<model, source_type>::type, model::pack_size>::type lanes;
+    array_eval_t<T1,size_t,lanes> child;
+    array_eval_t<T1,size_t,scalar_instruction_set<source_type>> tail;
+    return_type tmp;
+
+    void prepare(const std::tuple<cast_tag<T>, T1> &node) {
+        child.prepare(std::get<1>(node));
+        tail.prepare(std::get<1>(node));
+    }
+    void load(const std::tuple<cast_tag<T>, T1> &node, const U& userdata) {
+        load_lanes(std::get<1>(node), loop_index(userdata));
+    }
+    void store(const std::tuple<cast_tag<T>, T1> &, const U&) { }
+    void finish(const std::tuple<cast_tag<T>, T1> &node) {
+        child.finish(std::get<1>(node));
+        tail.finish(std::get<1>(node));
+    }
+    return_type operator()(const std::tuple<cast_tag<T>, T1> &node, const U& userdata) {
+        return convert(std::get<1>(node), loop_index(userdata));
+    }
+private:
+    void load_lanes(const T1 &node, size_t index) {
+        child.load(node, index);
+    }
+    return_type convert(const T1 &node, size_t index) {
+        return cast_convert<model, lanes>::apply(child(node, index));
+    }
+    // masked tails are converted lane by lane when they are loaded
+    template<typename I>
+    void load_lanes(const T1 &node, const I &index) {
+        T lanes_[model::pack_size] = { };
+        for(size_t k = 0;k<model::lanes(index);++k) {
+            tail.load(node, index.index+k);
+            lanes_[k] = T(tail(node, index.index+k));
+        }
+        tmp = model::loadu(lanes_, size_t(0));
+    }
+    template<typename I>
+    return_type convert(const T1 &, const I &) {
+        return tmp;
+    }
+};
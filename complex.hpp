@@ -0,0 +1,574 @@
+
+// complex_expr is a complex valued expression made of one ordinary
+// expression for the real part and one for the imaginary part. Complex
+// arithmetic combines the parts of the operands, so z*w is
+//
+//     (z.real()*w.real() - z.imag()*w.imag(), z.real()*w.imag() + z.imag()*w.real())
+//
+// which keeps every pack a pack of real numbers: a product is two
+// multiplications and two fused multiply-adds without any shuffles.
+// Assignments evaluate both parts in a single fused loop.
+template<typename R, typename I>
+class complex_expr {
+public:
+    complex_expr(const R &re, const I &im) : re_(re), im_(im) { }
+    complex_expr(const complex_expr&) = default;
+
+    const R& real() const { return re_; }
+    const I& imag() const { return im_; }
+private:
+    R re_;
+    I im_;
+};
+
+template<typename R, typename I>
+complex_expr<typename store_type<R>::type, typename store_type<I>::type> make_complex(const R &re, const I &im) {
+    return complex_expr<typename store_type<R>::type, typename store_type<I>::type>(re, im);
+}
+
+template<typename T>
+class complex_array;
+
+template<typename T>
+class interleaved_view;
+
+// is_complex tells whether T is a complex valued expression. Complex
+// expressions have no store_type, which keeps them out of the real
+// operators.
+template<typename T>
+struct is_complex {
+    static const bool value = false;
+};
+
+template<typename R, typename I>
+struct is_complex<complex_expr<R,I>> {
+    static const bool value = true;
+};
+template<typename R, typename I>
+struct store_type<complex_expr<R,I>> { };
+
+template<typename T>
+struct is_complex<complex_array<T>> {
+    static const bool value = true;
+};
+template<typename T>
+struct store_type<complex_array<T>> { };
+
+template<typename T>
+struct is_complex<interleaved_view<T>> {
+    static const bool value = true;
+};
+template<typename T>
+struct store_type<interleaved_view<T>> { };
+
+// interleaved_part<T, P> reads the real (P = 0) or imaginary (P = 1) parts
+// of size complex numbers stored as pairs at data.
+template<typename T, size_t P>
+class interleaved_part {
+public:
+    typedef T value_type;
+
+    interleaved_part(const T *data, size_t size) : size_(size), data_(data) { }
+    interleaved_part(const interleaved_part&) = default;
+
+    size_t size() const { return size_; }
+    const T* data() const { return data_; }
+private:
+    size_t size_;
+    const T *data_;
+};
+
+// complex_operand turns the operands of complex arithmetic into
+// complex_exprs. Real operands stay what they are, std::complex constants
+// become a pair of immediates.
+template<typename T>
+struct complex_operand {
+    typedef const T& type;
+    static type apply(const T &x) { return x; }
+};
+
+template<typename T>
+struct complex_operand<std::complex<T>> {
+    typedef complex_expr<T,T> type;
+    static type apply(const std::complex<T> &x) { return type(x.real(), x.imag()); }
+};
+
+template<typename R, typename I>
+struct complex_operand<complex_expr<R,I>> {
+    typedef const complex_expr<R,I>& type;
+    static type apply(const complex_expr<R,I> &x) { return x; }
+};
+
+template<typename T>
+struct complex_operand<complex_array<T>> {
+    typedef complex_expr<const arithmetic_array<T>&, const arithmetic_array<T>&> type;
+    static type apply(const complex_array<T> &x) { return type(x.real(), x.imag()); }
+};
+
+template<typename T>
+struct complex_operand<interleaved_view<T>> {
+    typedef typename std::remove_const<T>::type value_type;
+    typedef complex_expr<interleaved_part<value_type,0>, interleaved_part<value_type,1>> type;
+    static type apply(const interleaved_view<T> &x) {
+        return type(interleaved_part<value_type,0>(x.data(), x.size()), interleaved_part<value_type,1>(x.data(), x.size()));
+    }
+};
+
+// complex_parts<T, X> splits an operand into its parts, the imaginary part
+// of a real operand is a zero of type T
+template<typename T, typename X>
+struct complex_parts {
+    static X real(X x) { return x; }
+    static T imag(X) { return T(0); }
+};
+
+template<typename T, typename R, typename I>
+struct complex_parts<T, const complex_expr<R,I>&> {
+    static const R& real(const complex_expr<R,I> &x) { return x.real(); }
+    static const I& imag(const complex_expr<R,I> &x) { return x.imag(); }
+};
+
+template<typename T, typename R, typename I>
+struct complex_parts<T, complex_expr<R,I>> {
+    static R real(const complex_expr<R,I> &x) { return x.real(); }
+    static I imag(const complex_expr<R,I> &x) { return x.imag(); }
+};
+
+// complex_element is the real element type of a complex_expr
+template<typename R, typename I>
+struct complex_element {
+    typedef typename expression_traits<R>::value_type real_type;
+    typedef typename expression_traits<I>::value_type imag_type;
+    typedef typename std::conditional<!std::is_void<real_type>::value, real_type,
+        typename std::conditional<!std::is_void<imag_type>::value, imag_type, typename std::decay<R>::type>::type
+    >::type type;
+};
+
+struct complex_add {
+    template<typename R1, typename I1, typename R2, typename I2>
+    static auto apply(const complex_expr<R1,I1> &a, const complex_expr<R2,I2> &b)
+    -> decltype(make_complex(a.real() + b.real(), a.imag() + b.imag())) { return make_complex(a.real() + b.real(), a.imag() + b.imag()); }
+    template<typename R1, typename I1, typename T2>
+    static auto apply(const complex_expr<R1,I1> &a, const T2 &b)
+    -> decltype(make_complex(a.real() + b, a.imag())) { return make_complex(a.real() + b, a.imag()); }
+    template<typename T1, typename R2, typename I2>
+    static auto apply(const T1 &a, const complex_expr<R2,I2> &b)
+    -> decltype(make_complex(a + b.real(), b.imag())) { return make_complex(a + b.real(), b.imag()); }
+};
+
+struct complex_sub {
+    template<typename R1, typename I1, typename R2, typename I2>
+    static auto apply(const complex_expr<R1,I1> &a, const complex_expr<R2,I2> &b)
+    -> decltype(make_complex(a.real() - b.real(), a.imag() - b.imag())) { return make_complex(a.real() - b.real(), a.imag() - b.imag()); }
+    template<typename R1, typename I1, typename T2>
+    static auto apply(const complex_expr<R1,I1> &a, const T2 &b)
+    -> decltype(make_complex(a.real() - b, a.imag())) { return make_complex(a.real() - b, a.imag()); }
+    template<typename T1, typename R2, typename I2, typename Z = typename complex_element<R2,I2>::type>
+    static auto apply(const T1 &a, const complex_expr<R2,I2> &b)
+    -> decltype(make_complex(a - b.real(), Z(0) - b.imag())) { return make_complex(a - b.real(), Z(0) - b.imag()); }
+};
+
+struct complex_mul {
+    template<typename R1, typename I1, typename R2, typename I2>
+    static auto apply(const complex_expr<R1,I1> &a, const complex_expr<R2,I2> &b)
+    -> decltype(make_complex(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real())) {
+        return make_complex(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real());
+    }
+    template<typename R1, typename I1, typename T2>
+    static auto apply(const complex_expr<R1,I1> &a, const T2 &b)
+    -> decltype(make_complex(a.real()*b, a.imag()*b)) { return make_complex(a.real()*b, a.imag()*b); }
+    template<typename T1, typename R2, typename I2>
+    static auto apply(const T1 &a, const complex_expr<R2,I2> &b)
+    -> decltype(make_complex(a*b.real(), a*b.imag())) { return make_complex(a*b.real(), a*b.imag()); }
+};
+
+// division multiplies by the conjugate of the divisor and divides both
+// parts by its squared magnitude, which overflows for magnitudes beyond the
+// square root of the largest value
+struct complex_div {
+    template<typename R1, typename I1, typename R2, typename I2>
+    static auto apply(const complex_expr<R1,I1> &a, const complex_expr<R2,I2> &b)
+    -> decltype(make_complex((a.real()*b.real() + a.imag()*b.imag())/(b.real()*b.real() + b.imag()*b.imag()),
+                             (a.imag()*b.real() - a.real()*b.imag())/(b.real()*b.real() + b.imag()*b.imag()))) {
+        return make_complex((a.real()*b.real() + a.imag()*b.imag())/(b.real()*b.real() + b.imag()*b.imag()),
+                            (a.imag()*b.real() - a.real()*b.imag())/(b.real()*b.real() + b.imag()*b.imag()));
+    }
+    template<typename R1, typename I1, typename T2>
+    static auto apply(const complex_expr<R1,I1> &a, const T2 &b)
+    -> decltype(make_complex(a.real()/b, a.imag()/b)) { return make_complex(a.real()/b, a.imag()/b); }
+    template<typename T1, typename R2, typename I2, typename Z = typename complex_element<R2,I2>::type>
+    static auto apply(const T1 &a, const complex_expr<R2,I2> &b)
+    -> decltype(make_complex(a*b.real()/(b.real()*b.real() + b.imag()*b.imag()), (Z(0) - a*b.imag())/(b.real()*b.real() + b.imag()*b.imag()))) {
+        return make_complex(a*b.real()/(b.real()*b.real() + b.imag()*b.imag()), (Z(0) - a*b.imag())/(b.real()*b.real() + b.imag()*b.imag()));
+    }
+};
+
+// complex_result is the type of op applied to the operands a and b if at
+// least one of them is complex
+template<typename op, typename T1, typename T2, bool = is_complex<T1>::value || is_complex<T2>::value>
+struct complex_result { };
+
+template<typename op, typename T1, typename T2>
+struct complex_result<op, T1, T2, true> {
+    typedef decltype(op::apply(complex_operand<T1>::apply(std::declval<const T1&>()), complex_operand<T2>::apply(std::declval<const T2&>()))) type;
+};
+
+#define ARITHMETIC_ARRAY_CREATE_COMPLEX_BINARY(NAME,OP)\
+template<typename T1, typename T2>\
+typename complex_result<OP, T1, T2>::type \
+NAME(const T1 &a, const T2 &b) {\
+    return OP::apply(complex_operand<T1>::apply(a), complex_operand<T2>::apply(b));\
+}
+
+ARITHMETIC_ARRAY_CREATE_COMPLEX_BINARY(operator+, complex_add)
+ARITHMETIC_ARRAY_CREATE_COMPLEX_BINARY(operator-, complex_sub)
+ARITHMETIC_ARRAY_CREATE_COMPLEX_BINARY(operator*, complex_mul)
+ARITHMETIC_ARRAY_CREATE_COMPLEX_BINARY(operator/, complex_div)
+
+#undef ARITHMETIC_ARRAY_CREATE_COMPLEX_BINARY
+
+// real, imag and abs of a complex expression are real expressions, conj
+// negates the imaginary part. abs does not guard against overflow of the
+// squared magnitude.
+template<typename T1>
+auto real(const T1 &z) -> typename std::enable_if<is_complex<T1>::value, decltype(complex_operand<T1>::apply(z).real())>::type {
+    return complex_operand<T1>::apply(z).real();
+}
+
+template<typename T1>
+auto imag(const T1 &z) -> typename std::enable_if<is_complex<T1>::value, decltype(complex_operand<T1>::apply(z).imag())>::type {
+    return complex_operand<T1>::apply(z).imag();
+}
+
+template<typename R, typename I, typename Z = typename complex_element<R,I>::type>
+auto conj_parts(const complex_expr<R,I> &z) -> decltype(make_complex(z.real(), Z(0) - z.imag())) {
+    return make_complex(z.real(), Z(0) - z.imag());
+}
+
+template<typename T1>
+auto conj(const T1 &z) -> typename std::enable_if<is_complex<T1>::value, decltype(conj_parts(complex_operand<T1>::apply(z)))>::type {
+    return conj_parts(complex_operand<T1>::apply(z));
+}
+
+template<typename R, typename I>
+auto abs_parts(const complex_expr<R,I> &z) -> decltype(sqrt(z.real()*z.real() + z.imag()*z.imag())) {
+    return sqrt(z.real()*z.real() + z.imag()*z.imag());
+}
+
+template<typename T1>
+auto abs(const T1 &z) -> typename std::enable_if<is_complex<T1>::value, decltype(abs_parts(complex_operand<T1>::apply(z)))>::type {
+    return abs_parts(complex_operand<T1>::apply(z));
+}
+
+// complex_real and complex_imag are the parts of the right hand side of an
+// assignment to complex numbers of type T
+template<typename T, typename T1>
+auto complex_real(const T1 &x) -> decltype(complex_parts<T, typename complex_operand<T1>::type>::real(complex_operand<T1>::apply(x))) {
+    return complex_parts<T, typename complex_operand<T1>::type>::real(complex_operand<T1>::apply(x));
+}
+
+template<typename T, typename T1>
+auto complex_imag(const T1 &x) -> decltype(complex_parts<T, typename complex_operand<T1>::type>::imag(complex_operand<T1>::apply(x))) {
+    return complex_parts<T, typename complex_operand<T1>::type>::imag(complex_operand<T1>::apply(x));
+}
+
+// loop_index is the loop index below a shared node
+template<typename U>
+const U& loop_index(const U &index) { return index; }
+
+template<typename U, typename S>
+const U& loop_index(const shared_index<U,S> &index) { return index.index; }
+
+// interleaved_lanes moves packs of real and imaginary parts from and to
+// interleaved complex numbers. Full packs load two packs of pairs and
+// split them with shuffles, masked tails go through strided accesses.
+template<typename model>
+struct interleaved_lanes {
+    typedef typename model::value_type value_type;
+    typedef typename model::pack_type pack_type;
+
+    template<size_t P>
+    static pack_type load(const value_type *ptr, size_t index) {
+        const pack_type a = model::loadu(ptr, 2*index), b = model::loadu(ptr, 2*index+model::pack_size);
+        return P == 0 ? model::even(a, b) : model::odd(a, b);
+    }
+    template<size_t P, typename I>
+    static pack_type load(const value_type *ptr, const I &index) {
+        return model::load_strided(ptr+P, index, 2);
+    }
+    static void store(value_type *ptr, size_t index, pack_type re, pack_type im) {
+        model::storeu(ptr, 2*index, model::interleave_low(re, im));
+        model::storeu(ptr, 2*index+model::pack_size, model::interleave_high(re, im));
+    }
+    template<typename I>
+    static void store(value_type *ptr, const I &index, pack_type re, pack_type im) {
+        model::store_strided(ptr, index, 2, re);
+        model::store_strided(ptr+1, index, 2, im);
+    }
+};
+
+template<typename T, size_t P>
+struct is_node<interleaved_part<T,P>> {
+    static const bool value = true;
+};
+
+template<typename T, size_t P>
+struct store_type<interleaved_part<T,P>> {
+    typedef interleaved_part<T,P> type;
+};
+
+template<typename T, size_t P>
+struct rebase<interleaved_part<T,P>> {
+    typedef interleaved_part<T,P> type;
+    static type apply(const interleaved_part<T,P> &node, size_t offset) { return type(node.data()+2*offset, node.size()-std::min(offset, node.size())); }
+};
+
+// a part is two loads that are combined into one pack
+template<typename T, size_t P>
+struct count<interleaved_part<T,P>> {
+    static const int loads = 2;
+    static const int stores = 0;
+    static const int operations = 1;
+    static const int immediates = 0;
+};
+
+template<typename T, size_t P>
+struct register_need<interleaved_part<T,P>> {
+    static const int value = 2;
+};
+
+template<typename T, size_t P>
+struct is_source<interleaved_part<T,P>> {
+    static const bool value = true;
+};
+
+template<typename T, size_t P>
+struct expression_traits<interleaved_part<T,P>> {
+    typedef T value_type;
+    static size_t size(const interleaved_part<T,P> &node) { return node.size(); }
+};
+
+template<typename T1, size_t P, typename U, typename model>
+struct array_eval_t<interleaved_part<T1,P>,U,model> {
+    typedef typename model::pack_type return_type;
+    return_type tmp;
+    const T1 *ptr;
+    void prepare(const interleaved_part<T1,P> &node) { ptr = node.data(); }
+    void load(const interleaved_part<T1,P>&, const U &userdata) { tmp = interleaved_lanes<model>::template load<P>(ptr, loop_index(userdata)); }
+    void store(const interleaved_part<T1,P> &, const U &) { }
+    void finish(const interleaved_part<T1,P> &) { }
+    return_type operator()(const interleaved_part<T1,P> &, const U &) {
+        return tmp;
+    }
+};
+
+// store_interleaved nodes write the expressions re and im as pairs to a
+struct store_interleaved_tag { };
+template<typename T1, typename T2, typename T3>
+struct is_node<std::tuple<store_interleaved_tag, T1*, T2, T3>> {
+    static const bool value = true;
+};
+template<typename T1, typename T2, typename T3>
+std::tuple<store_interleaved_tag, T1*, typename store_type<T2>::type, typename store_type<T3>::type>
+store_interleaved(T1 *a, const T2 &re, const T3 &im) {
+    return std::tuple<store_interleaved_tag, T1*, typename store_type<T2>::type, typename store_type<T3>::type>(store_interleaved_tag(), a, re, im);
+}
+
+template<typename T1, typename T2, typename T3>
+struct count<std::tuple<store_interleaved_tag, T1*, T2, T3>> {
+    static const int loads = count<T2>::loads + count<T3>::loads;
+    static const int stores = count<T2>::stores + count<T3>::stores + 2;
+    static const int operations = count<T2>::operations + count<T3>::operations + 2;
+    static const int immediates = count<T2>::immediates + count<T3>::immediates;
+};
+
+// both parts are live until they are merged
+template<typename T1, typename T2, typename T3>
+struct register_need<std::tuple<store_interleaved_tag, T1*, T2, T3>> {
+    static const int value = need_max(2, binary_need(
+        register_need<T2>::value, count<T2>::loads,
+        register_need<T3>::value, count<T3>::loads));
+};
+
+template<typename T1, typename T2, typename T3, typename U, typename model>
+struct array_eval_t<std::tuple<store_interleaved_tag, T1*, T2, T3>,U,model> {
+    typedef std::tuple<store_interleaved_tag, T1*, T2, T3> node_type;
+    typedef typename model::pack_type return_type;
+    return_type re, im;
+    T1 *ptr;
+
+    array_eval_t<T2,U,model> real_part;
+    array_eval_t<T3,U,model> imag_part;
+
+    void prepare(const node_type &node) {
+        real_part.prepare(std::get<2>(node));
+        imag_part.prepare(std::get<3>(node));
+        ptr = std::get<1>(node);
+    }
+    void load(const node_type &node, const U& userdata) {
+        real_part.load(std::get<2>(node), userdata);
+        imag_part.load(std::get<3>(node), userdata);
+    }
+    void store(const node_type &node, const U& userdata) {
+        real_part.store(std::get<2>(node), userdata);
+        imag_part.store(std::get<3>(node), userdata);
+        interleaved_lanes<model>::store(ptr, loop_index(userdata), re, im);
+    }
+    void finish(const node_type &node) {
+        real_part.finish(std::get<2>(node));
+        imag_part.finish(std::get<3>(node));
+    }
+    void operator()(const node_type &node, const U& userdata) {
+        re = real_part(std::get<2>(node), userdata);
+        im = imag_part(std::get<3>(node), userdata);
+    }
+};
+
+// complex_array stores size complex numbers as two aligned arrays of real
+// and imaginary parts (split storage). real() and imag() are these arrays,
+// so they can be used in real expressions as well.
+template<typename T>
+class complex_array {
+public:
+    static_assert(std::is_floating_point<T>::value, "complex arrays need a floating point element type");
+
+    typedef std::complex<T> value_type;
+    typedef std::size_t size_type;
+    typedef vector_instruction_set<T> vector_model;
+    typedef scalar_instruction_set<T> scalar_model;
+
+    explicit complex_array(size_t size, std::complex<T> val = std::complex<T>())
+    : re_(size, val.real()), im_(size, val.imag()) { }
+
+    size_type size() const { return re_.size(); }
+    arithmetic_array<T>& real() { return re_; }
+    const arithmetic_array<T>& real() const { return re_; }
+    arithmetic_array<T>& imag() { return im_; }
+    const arithmetic_array<T>& imag() const { return im_; }
+    value_type operator[](size_type i) const { return value_type(re_[i], im_[i]); }
+
+    complex_array& operator=(const complex_array &rhs) {
+        assign<serial_policy>(rhs);
+        return *this;
+    }
+    template<typename T1>
+    complex_array& operator=(const T1 &rhs) {
+        assign<serial_policy>(rhs);
+        return *this;
+    }
+    template<typename T1>
+    complex_array& operator+=(const T1 &rhs) {
+        update<serial_policy>(*this + rhs);
+        return *this;
+    }
+    template<typename T1>
+    complex_array& operator-=(const T1 &rhs) {
+        update<serial_policy>(*this - rhs);
+        return *this;
+    }
+    template<typename T1>
+    complex_array& operator*=(const T1 &rhs) {
+        update<serial_policy>(*this * rhs);
+        return *this;
+    }
+    template<typename T1>
+    complex_array& operator/=(const T1 &rhs) {
+        update<serial_policy>(*this / rhs);
+        return *this;
+    }
+
+    // large plain assignments stream like the ones of arithmetic_array
+    template<typename policy, typename T1>
+    void assign(const T1 &rhs) {
+        if(2*size()*sizeof(T) >= streaming_threshold())
+            policy::template execute<vector_model, scalar_model>(fuse(stream(re_.data(), complex_real<T>(rhs)), stream(im_.data(), complex_imag<T>(rhs))), size());
+        else
+            update<policy>(rhs);
+    }
+    template<typename policy, typename T1>
+    void update(const T1 &rhs) {
+        policy::template execute<vector_model, scalar_model>(fuse(store(re_.data(), complex_real<T>(rhs)), store(im_.data(), complex_imag<T>(rhs))), size());
+    }
+private:
+    complex_array(const complex_array&) = delete;
+
+    arithmetic_array<T> re_;
+    arithmetic_array<T> im_;
+};
+
+// interleaved_view is a view of size complex numbers stored as pairs of
+// real and imaginary part like an array of std::complex<T>. Reading it
+// splits two loaded packs of pairs into a pack of real and one of imaginary
+// parts, assigning to it merges them again.
+template<typename T>
+class interleaved_view {
+public:
+    typedef typename std::remove_const<T>::type real_type;
+    typedef std::complex<real_type> value_type;
+    typedef std::size_t size_type;
+    typedef T* pointer;
+    typedef vector_instruction_set<real_type> vector_model;
+    typedef scalar_instruction_set<real_type> scalar_model;
+
+    static_assert(std::is_floating_point<real_type>::value, "complex views need a floating point element type");
+
+    // data points to 2*size elements, the real part of every number first
+    interleaved_view(pointer data, size_type size) : size_(size), data_(data) { }
+    interleaved_view(const interleaved_view&) = default;
+
+    size_type size() const { return size_; }
+    pointer data() const { return data_; }
+    value_type operator[](size_type i) const { return value_type(data_[2*i], data_[2*i+1]); }
+
+    interleaved_view& operator=(const interleaved_view &rhs) {
+        update<serial_policy>(rhs);
+        return *this;
+    }
+    template<typename T1>
+    interleaved_view& operator=(const T1 &rhs) {
+        update<serial_policy>(rhs);
+        return *this;
+    }
+    template<typename T1>
+    interleaved_view& operator+=(const T1 &rhs) {
+        update<serial_policy>(*this + rhs);
+        return *this;
+    }
+    template<typename T1>
+    interleaved_view& operator-=(const T1 &rhs) {
+        update<serial_policy>(*this - rhs);
+        return *this;
+    }
+    template<typename T1>
+    interleaved_view& operator*=(const T1 &rhs) {
+        update<serial_policy>(*this * rhs);
+        return *this;
+    }
+    template<typename T1>
+    interleaved_view& operator/=(const T1 &rhs) {
+        update<serial_policy>(*this / rhs);
+        return *this;
+    }
+
+    template<typename policy, typename T1>
+    void assign(const T1 &rhs) {
+        update<policy>(rhs);
+    }
+    template<typename policy, typename T1>
+    void update(const T1 &rhs) {
+        policy::template execute<vector_model, scalar_model>(store_interleaved(data_, complex_real<real_type>(rhs), complex_imag<real_type>(rhs)), size_);
+    }
+private:
+    size_type size_;
+    pointer data_;
+};
+
+template<typename T>
+interleaved_view<T> interleaved(std::complex<T> *data, size_t size) {
+    return interleaved_view<T>(reinterpret_cast<T*>(data), size);
+}
+
+template<typename T>
+interleaved_view<const T> interleaved(const std::complex<T> *data, size_t size) {
+    return interleaved_view<const T>(reinterpret_cast<const T*>(data), size);
+}
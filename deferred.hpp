@@ -0,0 +1,305 @@
+
+// deferred_block_bytes is the number of bytes the statements of a
+// statement_queue may touch per block. It defaults to half of the L2 cache
+// or 128KiB if the size is unknown.
+inline size_t& deferred_block_bytes() {
+    static size_t bytes = []() -> size_t {
+        long l2 = 0;
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+        l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        return l2 > 0 ? size_t(l2)/2 : size_t(128)<<10;
+    }();
+    return bytes;
+}
+
+// block_storage is the part of a block_array the queue needs to move its
+// buffer to the block being executed.
+class block_storage {
+public:
+    virtual ~block_storage() { }
+    virtual void bind(size_t capacity, size_t begin) = 0;
+};
+
+// block_array is a temporary that only exists inside a statement_queue.
+// It has size() elements but only stores the current block, so the values
+// it passes from one statement to the next never leave the cache. data()
+// is offset by the start of the block so indices stay the same as for the
+// other arrays of a statement. Its contents are meaningless outside of
+// statement_queue::execute.
+template<typename T>
+class block_array : public block_storage {
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef vector_instruction_set<T> vector_model;
+    typedef scalar_instruction_set<T> scalar_model;
+
+    explicit block_array(size_t size)
+    : size_(size), capacity_(0), base_(nullptr), buffer_(nullptr, &_mm_free) { }
+
+    size_type size() const { return size_; }
+    pointer data() { return base_; }
+    const_pointer data() const { return base_; }
+
+    void bind(size_t capacity, size_t begin) {
+        if(capacity > capacity_) {
+            buffer_.reset(static_cast<T*>(_mm_malloc(capacity*sizeof(T), vector_model::alignment)));
+            capacity_ = capacity;
+        }
+        base_ = buffer_.get() - begin;
+    }
+private:
+    block_array(const block_array&) = delete;
+
+    size_type size_;
+    size_type capacity_;
+    pointer base_;
+    std::unique_ptr<value_type[],void(*)(void*)> buffer_;
+};
+
+template<typename T>
+struct is_node<block_array<T>> {
+    static const bool value = true;
+};
+
+template<typename T>
+struct count<const block_array<T>&> {
+    static const int loads = 1;
+    static const int stores = 0;
+    static const int operations = 0;
+    static const int immediates = 0;
+};
+
+template<typename T>
+struct register_need<const block_array<T>&> {
+    static const int value = 1;
+};
+
+template<typename T>
+struct is_source<const block_array<T>&> {
+    static const bool value = true;
+};
+
+template<typename T>
+struct expression_traits<const block_array<T>&> {
+    typedef T value_type;
+    static size_t size(const block_array<T> &node) { return node.size(); }
+};
+
+template<typename T1, typename U, typename model>
+struct array_eval_t<const block_array<T1>&,U,model> {
+    typedef typename model::pack_type return_type;
+    return_type tmp;
+    const T1 *ptr;
+    void prepare(const block_array<T1> &node) { ptr = node.data(); }
+    void load(const block_array<T1>&, const U &userdata) { tmp = model::load(ptr, userdata); }
+    void store(const block_array<T1> &, const U &) { }
+    void finish(const block_array<T1> &) { }
+    return_type operator()(const block_array<T1> &, const U &) {
+        return tmp;
+    }
+};
+
+// deferred_target runs the statement that assigns rhs to an array on
+// [begin, end). Queued assignments use regular stores so the next statement
+// finds the result in the cache. Arrays that no later statement reads are
+// streamed like a plain assignment would be.
+template<typename A>
+struct deferred_target;
+
+template<typename T, size_t N>
+struct deferred_target<arithmetic_array<T,N>> {
+    template<typename T1>
+    static void run(arithmetic_array<T,N> &array, const T1 &rhs, size_t end, size_t begin, bool streaming) {
+        typedef executor<vector_instruction_set<T>, scalar_instruction_set<T>> loops;
+        if(streaming)
+            loops::run(stream(array.data(), rhs), end, begin);
+        else
+            loops::run(store(array.data(), rhs), end, begin);
+    }
+};
+
+template<typename T>
+struct deferred_target<array_view<T>> {
+    template<typename T1>
+    static void run(array_view<T> &array, const T1 &rhs, size_t end, size_t begin, bool) {
+        typedef typename array_view<T>::value_type value_type;
+        executor<vector_instruction_set<value_type>, scalar_instruction_set<value_type>>::run(storeu(array.data(), rhs), end, begin);
+    }
+};
+
+template<typename T>
+struct deferred_target<block_array<T>> {
+    template<typename T1>
+    static void run(block_array<T> &array, const T1 &rhs, size_t end, size_t begin, bool) {
+        executor<vector_instruction_set<T>, scalar_instruction_set<T>>::run(store(array.data(), rhs), end, begin);
+    }
+};
+
+// deferred_sources lists the addresses of the arrays a statement reads
+template<size_t I = 0, typename... Ts>
+typename std::enable_if<I == sizeof...(Ts), void>::type
+deferred_sources(const std::tuple<Ts...> &, std::vector<const void*> &) { }
+
+template<size_t I = 0, typename... Ts>
+typename std::enable_if<(I < sizeof...(Ts)), void>::type
+deferred_sources(const std::tuple<Ts...> &sources, std::vector<const void*> &addresses) {
+    addresses.push_back(std::get<I>(sources).data());
+    deferred_sources<I+1>(sources, addresses);
+}
+
+// statement_queue records assignments instead of executing them. execute()
+// splits the index range into blocks of deferred_block_bytes() and runs
+// every statement on one block before moving on to the next, so
+//
+//     arrr::statement_queue q;
+//     q(t) = a*b;
+//     q(u) = t + c;
+//     q(y) = arrr::sqrt(u);
+//     q.execute();
+//
+// reads a, b and c and writes y once instead of making three passes over
+// memory. t and u can be block_arrays from temporary() in which case they
+// are never written to memory at all. All statements are elementwise, so
+// running them blockwise gives the same result as running them in order.
+// The arrays have to outlive the queue, reductions pushed into the queue
+// only hold their result after execute(). Statements still queued when the
+// queue is destroyed are executed.
+class statement_queue {
+public:
+    template<typename A>
+    class reference {
+    public:
+        reference(statement_queue &queue, A &array) : queue_(queue), array_(array) { }
+
+        template<typename T1>
+        reference& operator=(const T1 &rhs) {
+            queue_.assign(array_, rhs);
+            return *this;
+        }
+        template<typename T1>
+        reference& operator+=(const T1 &rhs) {
+            queue_.assign(array_, array_ + rhs);
+            return *this;
+        }
+        template<typename T1>
+        reference& operator-=(const T1 &rhs) {
+            queue_.assign(array_, array_ - rhs);
+            return *this;
+        }
+        template<typename T1>
+        reference& operator*=(const T1 &rhs) {
+            queue_.assign(array_, array_ * rhs);
+            return *this;
+        }
+        template<typename T1>
+        reference& operator/=(const T1 &rhs) {
+            queue_.assign(array_, array_ / rhs);
+            return *this;
+        }
+    private:
+        statement_queue &queue_;
+        A &array_;
+    };
+
+    statement_queue() : size_(0), bytes_(0) { }
+    ~statement_queue() { execute(); }
+
+    template<typename A>
+    reference<A> operator()(A &array) {
+        return reference<A>(*this, array);
+    }
+
+    // temporary creates a block_array owned by the queue
+    template<typename T>
+    block_array<T>& temporary(size_t size) {
+        block_array<T> *array = new block_array<T>(size);
+        temporaries_.emplace_back(array);
+        return *array;
+    }
+
+    // push queues a complete statement (store, reduce, fuse...)
+    template<typename T1>
+    typename std::enable_if<is_node<T1>::value, void>::type push(const T1 &node) {
+        typedef expression_traits<T1> traits;
+        typedef typename traits::value_type value_type;
+        statement s;
+        s.size = traits::size(node);
+        s.bytes = 0;
+        s.target = nullptr;
+        s.run = [node](size_t end, size_t begin, bool) {
+            executor<vector_instruction_set<value_type>, scalar_instruction_set<value_type>>::run(node, end, begin);
+        };
+        record<value_type, T1>(s, node);
+    }
+
+    template<typename A, typename T1>
+    void assign(A &array, const T1 &rhs) {
+        typedef typename A::value_type value_type;
+        A *target = &array;
+        statement s;
+        s.size = array.size();
+        s.bytes = array.size()*sizeof(value_type);
+        s.target = array.data();
+        s.run = [target, rhs](size_t end, size_t begin, bool streaming) {
+            deferred_target<A>::run(*target, rhs, end, begin, streaming);
+        };
+        record<value_type, T1>(s, rhs);
+        bytes_ += sizeof(value_type);
+    }
+
+    // execute runs all queued statements and empties the queue. Blocks are
+    // multiples of 1024 elements, which keeps every block start aligned
+    // to the unrolled steps of every instruction set.
+    void execute() {
+        const size_t granularity = 1024;
+        const size_t block = std::max(granularity, deferred_block_bytes()/std::max(bytes_, size_t(1))/granularity*granularity);
+        std::vector<bool> streaming(statements_.size());
+        for(size_t k = 0; k < statements_.size(); ++k)
+            streaming[k] = statements_[k].bytes >= streaming_threshold() && !read_after(k);
+        for(size_t begin = 0; begin < size_; begin += block) {
+            for(std::unique_ptr<block_storage> &temporary : temporaries_)
+                temporary->bind(block, begin);
+            for(size_t k = 0; k < statements_.size(); ++k)
+                if(begin < statements_[k].size)
+                    statements_[k].run(std::min(statements_[k].size, begin+block), begin, streaming[k]);
+        }
+        statements_.clear();
+        size_ = 0;
+        bytes_ = 0;
+    }
+private:
+    statement_queue(const statement_queue&) = delete;
+
+    struct statement {
+        size_t size;
+        size_t bytes;
+        const void *target;
+        std::vector<const void*> sources;
+        std::function<void(size_t, size_t, bool)> run;
+    };
+
+    template<typename value_type, typename T1>
+    void record(statement &s, const T1 &node) {
+        deferred_sources(shared_loads<T1>::all::sources(node), s.sources);
+        size_ = std::max(size_, s.size);
+        bytes_ += (count<T1>::loads + count<T1>::stores)*sizeof(value_type);
+        statements_.push_back(std::move(s));
+    }
+
+    // read_after tells whether a statement after k reads the array k writes
+    bool read_after(size_t k) const {
+        for(size_t j = k+1; j < statements_.size(); ++j)
+            if(std::find(statements_[j].sources.begin(), statements_[j].sources.end(), statements_[k].target) != statements_[j].sources.end())
+                return true;
+        return false;
+    }
+
+    std::vector<statement> statements_;
+    std::vector<std::unique_ptr<block_storage>> temporaries_;
+    size_t size_;
+    size_t bytes_;
+};
@@ -0,0 +1,97 @@
+#if !defined(__GNUC__) || !(defined(__x86_64__) || defined(__i386__))
+#error "ARRR_DISPATCH needs the target attribute of gcc or clang on x86"
+#endif
+
+// isa names the instruction sets the dispatcher chooses from, from the
+// oldest to the newest.
+enum class isa { sse2, avx, avx2, avx512 };
+
+// detected_isa is the newest instruction set supported by both the cpu and
+// the operating system.
+inline isa detected_isa() {
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return isa::avx512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+        return isa::avx2;
+    if(__builtin_cpu_supports("avx"))
+        return isa::avx;
+    return isa::sse2;
+}
+
+// active_isa is the instruction set used by every following execution. It
+// starts out as detected_isa() or as the one named by the environment
+// variable ARRR_ISA (sse2, avx, avx2 or avx512) if that is older. Assigning
+// to it forces an instruction set which the cpu has to support.
+inline isa& active_isa() {
+    static isa level = []() -> isa {
+        static const char *const names[] = { "sse2", "avx", "avx2", "avx512" };
+        const isa detected = detected_isa();
+        const char *name = std::getenv("ARRR_ISA");
+        for(int k = 0;name != nullptr && k<4;++k)
+            if(std::strcmp(name, names[k]) == 0)
+                return std::min(detected, isa(k));
+        return detected;
+    }();
+    return level;
+}
+
+// dispatch_instruction_set only describes what all candidates have in
+// common: arrays are aligned for the widest vectors and pack_size is a
+// multiple of every pack size so parallel chunks stay aligned.
+template<typename T>
+struct dispatch_instruction_set {
+    typedef T value_type;
+    static const size_t pack_size = sizeof(T) < 64 ? 64/sizeof(T) : 1;
+    static const size_t alignment = 64;
+};
+
+// dispatch_target<level>::run is the loop compiled for one instruction set.
+// flatten inlines the whole expression evaluation into it so none of the
+// instruction set functions is called across targets.
+template<isa level>
+struct dispatch_target;
+
+#define ARRR_DISPATCH_TARGET(NAME, TARGET)\
+template<>\
+struct dispatch_target<isa::NAME> {\
+    template<typename T, typename scalar_model, typename T1>\
+    __attribute__((target(TARGET), flatten))\
+    static void run(T1 expr, size_t end, size_t begin) {\
+        executor<NAME::instruction_set<T>, scalar_model>::run(expr, end, begin);\
+    }\
+};
+
+ARRR_DISPATCH_TARGET(sse2, "sse2")
+ARRR_DISPATCH_TARGET(avx, "avx")
+ARRR_DISPATCH_TARGET(avx2, "avx2,fma,f16c")
+ARRR_DISPATCH_TARGET(avx512, "avx512f,avx2,fma,f16c")
+
+#undef ARRR_DISPATCH_TARGET
+
+template<typename T, typename scalar_model>
+struct executor<dispatch_instruction_set<T>, scalar_model> {
+    template<typename T1>
+    static void run(T1 expr, size_t end, size_t begin = 0) {
+        switch(active_isa()) {
+            case isa::avx512:
+                dispatch_target<isa::avx512>::template run<T, scalar_model>(expr, end, begin);
+                break;
+            case isa::avx2:
+                dispatch_target<isa::avx2>::template run<T, scalar_model>(expr, end, begin);
+                break;
+            case isa::avx:
+                dispatch_target<isa::avx>::template run<T, scalar_model>(expr, end, begin);
+                break;
+            default:
+                dispatch_target<isa::sse2>::template run<T, scalar_model>(expr, end, begin);
+                break;
+        }
+    }
+    // the pack size is only known at runtime, so statically sized arrays
+    // use the regular loop
+    template<size_t N, typename T1>
+    static void run_static(T1 expr) {
+        run(expr, N);
+    }
+};
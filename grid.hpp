@@ -0,0 +1,187 @@
+
+// grid_rows runs f(r) for the rows of a grid assignment, split among the
+// pool threads for the parallel policy.
+template<typename policy>
+struct grid_rows {
+    template<typename F>
+    static void run(size_t rows, size_t, const F &f) {
+        for(size_t r = 0; r < rows; ++r)
+            f(r);
+    }
+};
+
+template<>
+struct grid_rows<parallel_policy> {
+    template<typename F>
+    static void run(size_t rows, size_t row_size, const F &f) {
+        thread_pool &pool = default_thread_pool();
+        const size_t threads = pool.size();
+        if(threads < 2 || rows*row_size < parallel_threshold()) {
+            grid_rows<serial_policy>::run(rows, row_size, f);
+            return;
+        }
+        const size_t chunk = (rows+threads-1)/threads;
+        pool.run([&](size_t k) {
+            const size_t end = std::min(rows, (k+1)*chunk);
+            for(size_t r = k*chunk; r < end; ++r)
+                f(r);
+        });
+    }
+};
+
+// grid is a D dimensional (1 to 3) array of nx*ny*nz elements surrounded by
+// H layers of halo cells on every side. x is the contiguous dimension. Rows
+// are padded so every row starts aligned, which leaves room for the halo in
+// front of it.
+//
+// Assignments run the loops row by row over the interior. shift(u, dx, dy, dz)
+// reads the neighbour of every element, so a five point stencil is
+//
+//     un = c0*u + c1*(shift(u, -1, 0) + shift(u, 1, 0) + shift(u, 0, -1) + shift(u, 0, 1));
+//
+// Neighbours along x are unaligned loads of the row that is loaded anyway,
+// neighbours along y and z are aligned rows of the same plane. Shifts must
+// not leave the halo, statements may only combine grids of the same shape,
+// shifts and scalars, and the destination must not be read shifted. The
+// halo is not written by assignments, fill_halo, periodic_halo and
+// extend_halo set it up for the boundary conditions.
+template<typename T, size_t D, size_t H = 1>
+class grid {
+public:
+    static_assert(D >= 1 && D <= 3, "grids have one to three dimensions");
+
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef vector_instruction_set<T> vector_model;
+    typedef scalar_instruction_set<T> scalar_model;
+
+    explicit grid(size_t nx, size_t ny = 1, size_t nz = 1, T val = T())
+    : nx_(nx), ny_(D >= 2 ? ny : 1), nz_(D >= 3 ? nz : 1),
+      lead_(round_up(H)), pitch_(round_up(lead_+nx_+H)), plane_(pitch_*(ny_+2*halo(2))),
+      data_(static_cast<T*>(_mm_malloc(plane_*(nz_+2*halo(3))*sizeof(T), vector_model::alignment)), &_mm_free)
+    {
+        std::fill(data_.get(), data_.get()+plane_*(nz_+2*halo(3)), val);
+        origin_ = data_.get() + lead_ + halo(2)*pitch_ + halo(3)*plane_;
+    }
+
+    size_type nx() const { return nx_; }
+    size_type ny() const { return ny_; }
+    size_type nz() const { return nz_; }
+    size_type size() const { return nx_*ny_*nz_; }
+
+    // origin points to the element (0, 0, 0), offset is the distance of
+    // (x, y, z) from it. Halo cells have coordinates from -H to n+H-1.
+    pointer origin() { return origin_; }
+    const_pointer origin() const { return origin_; }
+    ptrdiff_t offset(ptrdiff_t x, ptrdiff_t y = 0, ptrdiff_t z = 0) const { return x + y*ptrdiff_t(pitch_) + z*ptrdiff_t(plane_); }
+    reference operator()(ptrdiff_t x, ptrdiff_t y = 0, ptrdiff_t z = 0) { return origin_[offset(x, y, z)]; }
+    const_reference operator()(ptrdiff_t x, ptrdiff_t y = 0, ptrdiff_t z = 0) const { return origin_[offset(x, y, z)]; }
+
+    grid& operator=(const grid &rhs) {
+        assign<serial_policy>(rhs);
+        return *this;
+    }
+    template<typename T1>
+    grid& operator=(const T1 &rhs) {
+        assign<serial_policy>(rhs);
+        return *this;
+    }
+    template<typename T1>
+    grid& operator+=(const T1 &rhs) {
+        update<serial_policy>(*this + rhs);
+        return *this;
+    }
+    template<typename T1>
+    grid& operator-=(const T1 &rhs) {
+        update<serial_policy>(*this - rhs);
+        return *this;
+    }
+    template<typename T1>
+    grid& operator*=(const T1 &rhs) {
+        update<serial_policy>(*this * rhs);
+        return *this;
+    }
+    template<typename T1>
+    grid& operator/=(const T1 &rhs) {
+        update<serial_policy>(*this / rhs);
+        return *this;
+    }
+
+    template<typename policy, typename T1>
+    void assign(const T1 &rhs) {
+        update<policy>(rhs);
+    }
+    template<typename policy, typename T1>
+    void update(const T1 &rhs) {
+        typedef typename store_type<T1>::type node_type;
+        const node_type node(rhs);
+        grid_rows<policy>::run(ny_*nz_, nx_, [&](size_t r) {
+            const size_t row = (r%ny_)*pitch_ + (r/ny_)*plane_;
+            execute<vector_model, scalar_model>(store(origin_+row, rebase<node_type>::apply(node, row)), nx_);
+        });
+    }
+
+    void fill_halo(T val) {
+        for_halo([&](ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) { (*this)(x, y, z) = val; });
+    }
+    // periodic_halo copies the interior from the opposite side
+    void periodic_halo() {
+        for_halo([&](ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) { (*this)(x, y, z) = (*this)(wrap(x, nx_), wrap(y, ny_), wrap(z, nz_)); });
+    }
+    // extend_halo copies the nearest interior element (zero gradient)
+    void extend_halo() {
+        for_halo([&](ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) { (*this)(x, y, z) = (*this)(clamp(x, nx_), clamp(y, ny_), clamp(z, nz_)); });
+    }
+private:
+    grid(const grid&) = delete;
+
+    static size_t round_up(size_t n) {
+        const size_t step = vector_model::alignment/sizeof(T) > 0 ? vector_model::alignment/sizeof(T) : 1;
+        return (n+step-1)/step*step;
+    }
+    static size_t halo(size_t dim) { return D >= dim ? H : 0; }
+    static ptrdiff_t wrap(ptrdiff_t i, size_t n) { return (i%ptrdiff_t(n) + ptrdiff_t(n))%ptrdiff_t(n); }
+    static ptrdiff_t clamp(ptrdiff_t i, size_t n) { return std::min(std::max(i, ptrdiff_t(0)), ptrdiff_t(n)-1); }
+
+    template<typename F>
+    void for_halo(const F &f) {
+        if(H == 0)
+            return;
+        const ptrdiff_t h = H, hy = halo(2), hz = halo(3);
+        const ptrdiff_t nx = nx_, ny = ny_, nz = nz_;
+        for(ptrdiff_t z = -hz; z < nz+hz; ++z) {
+            for(ptrdiff_t y = -hy; y < ny+hy; ++y) {
+                const bool inner = y >= 0 && y < ny && z >= 0 && z < nz;
+                for(ptrdiff_t x = -h; x < nx+h; x = (inner && x == -1) ? nx : x+1)
+                    f(x, y, z);
+            }
+        }
+    }
+
+    size_type nx_, ny_, nz_;
+    size_type lead_, pitch_, plane_;
+    std::unique_ptr<value_type[],void(*)(void*)> data_;
+    pointer origin_;
+};
+
+template<typename T, size_t D, size_t H>
+struct is_node<grid<T,D,H>> {
+    static const bool value = true;
+};
+
+// a grid inside a statement becomes a view of the row being computed
+template<typename T, size_t D, size_t H>
+struct rebase<const grid<T,D,H>&> {
+    typedef array_view<const T> type;
+    static type apply(const grid<T,D,H> &node, size_t offset) { return type(node.origin()+offset, node.nx()); }
+};
+
+// shift reads the element dx, dy, dz away from the one being computed
+template<typename T, size_t D, size_t H>
+array_view<const T> shift(const grid<T,D,H> &u, ptrdiff_t dx, ptrdiff_t dy = 0, ptrdiff_t dz = 0) {
+    return array_view<const T>(u.origin()+u.offset(dx, dy, dz), u.nx());
+}
@@ -0,0 +1,152 @@
+
+// Rounding policies of the conversions to 16 bit floating point types. mode
+// is the rounding control of the F16C and avx-512 conversion instructions.
+struct round_to_nearest { static const int mode = 0; };
+struct round_down { static const int mode = 1; };
+struct round_up { static const int mode = 2; };
+struct round_toward_zero { static const int mode = 3; };
+
+// rounds_away tells whether a value that lost the bits rest (against half
+// of the last kept bit) is rounded away from zero
+inline bool rounds_away(int mode, bool negative, uint32_t rest, uint32_t half, bool odd) {
+    switch(mode) {
+        case round_to_nearest::mode: return rest > half || (rest == half && odd);
+        case round_down::mode: return negative && rest != 0;
+        case round_up::mode: return !negative && rest != 0;
+        default: return false;
+    }
+}
+
+inline uint16_t float_to_half_bits(float f, int mode) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u, magnitude = bits & 0x7fffffffu, exponent = magnitude >> 23;
+    const bool negative = sign != 0;
+    if(magnitude > 0x7f800000u)
+        return uint16_t(sign | 0x7e00u | (magnitude >> 13));
+    if(magnitude == 0x7f800000u)
+        return uint16_t(sign | 0x7c00u);
+    // overflows become infinity or the largest finite value
+    if(exponent >= 143)
+        return uint16_t(sign | (rounds_away(mode, negative, 1, 0, false) ? 0x7c00u : 0x7bffu));
+    if(exponent >= 113) {
+        const uint32_t value = ((exponent - 112) << 10) | ((magnitude >> 13) & 0x3ffu);
+        return uint16_t(sign | (value + rounds_away(mode, negative, magnitude & 0x1fffu, 0x1000u, value & 1u)));
+    }
+    // subnormal results, a carry out of them makes the smallest normal number
+    const uint32_t shift = 126 - exponent;
+    if(shift > 24)
+        return uint16_t(sign | rounds_away(mode, negative, magnitude != 0, 2, false));
+    const uint32_t m = (magnitude & 0x7fffffu) | 0x800000u, value = m >> shift;
+    return uint16_t(sign | (value + rounds_away(mode, negative, m & ((1u << shift) - 1), 1u << (shift - 1), value & 1u)));
+}
+
+inline float half_bits_to_float(uint16_t h) {
+    const uint32_t sign = uint32_t(h & 0x8000u) << 16, exponent = (h >> 10) & 0x1fu, mantissa = h & 0x3ffu;
+    if(exponent == 0) {
+        const float f = float(mantissa)*5.9604644775390625e-8f;
+        return sign ? -f : f;
+    }
+    const uint32_t bits = sign | (exponent == 31 ? 0x7f800000u : (exponent + 112) << 23) | (mantissa << 13);
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// bfloat16 keeps the upper half of a float, rounding adds to the lower half
+// before it is cut off
+inline uint16_t float_to_bfloat16_bits(float f, int mode) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    if((bits & 0x7fffffffu) > 0x7f800000u)
+        return uint16_t((bits >> 16) | 0x40u);
+    const bool negative = (bits >> 31) != 0;
+    uint32_t bias = 0;
+    if(mode == round_to_nearest::mode)
+        bias = 0x7fffu + ((bits >> 16) & 1u);
+    else if(mode == round_down::mode || mode == round_up::mode)
+        bias = negative == (mode == round_down::mode) ? 0xffffu : 0u;
+    return uint16_t((bits + bias) >> 16);
+}
+
+inline float bfloat16_bits_to_float(uint16_t h) {
+    const uint32_t bits = uint32_t(h) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// basic_half is an IEEE binary16 number and basic_bfloat16 the upper half of
+// a float. They are storage types: arrays of them take part in expressions
+// as float, the instruction sets widen them on load and narrow them with the
+// rounding R on store. Both convert implicitly from and to float.
+template<typename R = round_to_nearest>
+struct basic_half {
+    typedef R rounding;
+    uint16_t bits;
+
+    basic_half() = default;
+    basic_half(float f) : bits(float_to_half_bits(f, R::mode)) { }
+    operator float() const { return half_bits_to_float(bits); }
+};
+
+template<typename R = round_to_nearest>
+struct basic_bfloat16 {
+    typedef R rounding;
+    uint16_t bits;
+
+    basic_bfloat16() = default;
+    basic_bfloat16(float f) : bits(float_to_bfloat16_bits(f, R::mode)) { }
+    operator float() const { return bfloat16_bits_to_float(bits); }
+};
+
+typedef basic_half<> half;
+typedef basic_bfloat16<> bfloat16;
+
+template<typename T>
+struct is_float16 {
+    static const bool value = false;
+};
+
+template<typename R>
+struct is_float16<basic_half<R>> {
+    static const bool value = true;
+};
+
+template<typename R>
+struct is_float16<basic_bfloat16<R>> {
+    static const bool value = true;
+};
+
+// compute_type is the element type expressions over arrays of T use
+template<typename T>
+struct compute_type {
+    typedef typename std::conditional<is_float16<T>::value, float, T>::type type;
+};
+
+// ARRR_FLOAT16_ACCESS adds loads and stores of 16 bit floating point arrays
+// to a float instruction set in terms of its widen and narrow functions.
+// ARRR_FLOAT16_MASKED_ACCESS does the same for masked tails through a
+// buffer of one pack.
+#define ARRR_FLOAT16_ACCESS\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type load(const S *ptr, size_t index) { return widen(ptr+index); }\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type loadu(const S *ptr, size_t index) { return widen(ptr+index); }\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type store(S *ptr, size_t index, pack_type val) { narrow(ptr+index, val); return val; }\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type storeu(S *ptr, size_t index, pack_type val) { narrow(ptr+index, val); return val; }\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type stream(S *ptr, size_t index, pack_type val) { narrow(ptr+index, val); return val; }
+
+#define ARRR_FLOAT16_MASKED_ACCESS\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type load(const S *ptr, const masked_index &index) {\
+        S x[pack_size] = { };\
+        std::copy(ptr+index.index, ptr+index.index+lanes(index), x);\
+        return widen(x);\
+    }\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type loadu(const S *ptr, const masked_index &index) { return load(ptr, index); }\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type store(S *ptr, const masked_index &index, pack_type val) {\
+        S x[pack_size];\
+        narrow(x, val);\
+        std::copy(x, x+lanes(index), ptr+index.index);\
+        return val;\
+    }\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type storeu(S *ptr, const masked_index &index, pack_type val) { return store(ptr, index, val); }\
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type stream(S *ptr, const masked_index &index, pack_type val) { return store(ptr, index, val); }
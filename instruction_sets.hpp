@@ -1,5 +1,12 @@
 #include <immintrin.h>
 
+// unsigned_bits<bytes>::type is the unsigned integer of the given size
+template<size_t bytes> struct unsigned_bits { };
+template<> struct unsigned_bits<1> { typedef uint8_t type; };
+template<> struct unsigned_bits<2> { typedef uint16_t type; };
+template<> struct unsigned_bits<4> { typedef uint32_t type; };
+template<> struct unsigned_bits<8> { typedef uint64_t type; };
+
 template<typename T>
 struct scalar_instruction_set {
     typedef T value_type;
@@ -7,17 +14,75 @@ struct scalar_instruction_set {
     static const size_t pack_size = 1;
     static const size_t alignment = 16;
     static const size_t registers = 8;
+    static const bool masked_tail = false;
 
     template<typename T2>
     static pack_type set(T2 value) { return value; }
     static pack_type load(const value_type *ptr, size_t index) { return ptr[index]; }
     static pack_type store(value_type *ptr, size_t index, pack_type val) { ptr[index] = val; return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return ptr[index]; }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { ptr[index] = val; return val; }
     static pack_type stream(value_type *ptr, size_t index, pack_type val) { ptr[index] = val; return val; }
+    static void fence() { }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+
+    // gather reads base[indices[index]], scatter writes it and scatter_add
+    // adds to it
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return base[indices[index]]; }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { base[indices[index]] = val; }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { base[indices[index]] = binary<add_tag>(base[indices[index]], val); }
+
+    // load_strided and store_strided access ptr[index*stride]
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return ptr[index*stride]; }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { ptr[index*stride] = val; }
+    // transpose turns pack_size packs of pack_size lanes into their columns
+    static void transpose(pack_type *) { }
+    // even and odd pick the even and odd elements of the 2*pack_size
+    // elements in a and b, interleave_low and interleave_high merge two packs
+    // element by element into the first and second half of the result
+    static pack_type even(pack_type a, pack_type) { return a; }
+    static pack_type odd(pack_type, pack_type b) { return b; }
+    static pack_type interleave_low(pack_type a, pack_type) { return a; }
+    static pack_type interleave_high(pack_type, pack_type b) { return b; }
+    // widen and narrow convert pack_size 16 bit floating point numbers
+    template<typename S> static typename std::enable_if<is_float16<S>::value, pack_type>::type widen(const S *ptr) { return pack_type(float(*ptr)); }
+    template<typename S> static typename std::enable_if<is_float16<S>::value>::type narrow(S *ptr, pack_type val) { *ptr = S(float(val)); }
+    ARRR_FLOAT16_ACCESS
+
+    // masks use the same bit patterns as the vector compare instructions,
+    // so masked values are NaN for floating point types
+    typedef typename unsigned_bits<sizeof(T)>::type bits_type;
+    static bits_type bits(pack_type a) { bits_type b; std::memcpy(&b, &a, sizeof(b)); return b; }
+    static pack_type from_bits(bits_type b) { pack_type a; std::memcpy(&a, &b, sizeof(a)); return a; }
+    static pack_type mask(bool value) { return from_bits(value ? bits_type(~bits_type(0)) : bits_type(0)); }
+
+    static pack_type round(pack_type a) { return std::nearbyint(a); }
+    static pack_type pow2(pack_type n) { return std::ldexp(pack_type(1), int(n)); }
+    static pack_type exponent(pack_type a) { return pack_type(std::ilogb(a)); }
+
+    // the estimates match the ones of the sse and avx instruction sets so
+    // remainders come out the same as the vector body
+#if defined(__SSE__)
+    static float rsqrt_estimate(float a) { return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(a))); }
+    static double rsqrt_estimate(double a) { return rsqrt_estimate(float(a)); }
+    static float rcp_estimate(float a) { return _mm_cvtss_f32(_mm_rcp_ss(_mm_set_ss(a))); }
+    static double rcp_estimate(double a) { return rcp_estimate(float(a)); }
+#endif
+    template<typename T2>
+    static T2 rsqrt_estimate(T2 a) { return T2(1)/std::sqrt(a); }
+    template<typename T2>
+    static T2 rcp_estimate(T2 a) { return T2(1)/a; }
 
     template<typename T2, typename tag> struct unary_op { };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return from_bits(bits_type(~bits(a))); } };
     template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return std::sqrt(a); } };
-    template<typename T2> struct unary_op<T2,rsqrt_tag> { T2 operator()(T2 a) { return value_type(1)/std::sqrt(a); } };
-    template<typename T2> struct unary_op<T2,rcp_tag> { T2 operator()(T2 a) { return value_type(1)/a; } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<scalar_instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<scalar_instruction_set>::rcp(a, P()); } };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<scalar_instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<scalar_instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<scalar_instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<scalar_instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<scalar_instruction_set>::tanh(a); } };
 
     template<class tag>
     static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
@@ -29,33 +94,645 @@ struct scalar_instruction_set {
     template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return a/b; } };
     template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return a<b?a:b; } };
     template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return a>b?a:b; } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return mask(a<b); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return mask(a<=b); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return mask(a>b); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return mask(a>=b); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return mask(a==b); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return mask(a!=b); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return from_bits(bits_type(bits(a)&bits(b))); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return from_bits(bits_type(bits(a)|bits(b))); } };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<scalar_instruction_set>::pow(a, b); } };
+
+    template<class tag>
+    static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    // with hardware fma the scalar tail rounds once just like the vector body
+#if defined(__FMA__) || defined(__AVX512F__)
+    static float fused(float a, float b, float c) { return std::fma(a, b, c); }
+    static double fused(double a, double b, double c) { return std::fma(a, b, c); }
+#endif
+    template<typename T2>
+    static T2 fused(T2 a, T2 b, T2 c) { return a*b+c; }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return fused(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return fused(a, b, T2(-c)); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return fused(T2(-a), b, c); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return bits(a) ? b : c; } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) { return a; }
+};
+
+// indexed_lanes gathers and scatters one element at a time through an
+// aligned buffer for instruction sets without gather or scatter
+// instructions. count is the number of valid lanes.
+template<typename model>
+struct indexed_lanes {
+    typedef typename model::value_type value_type;
+    typedef typename model::pack_type pack_type;
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index, size_t count) {
+        ARRR_ALIGN(64) value_type x[model::pack_size] = { };
+        for(size_t k = 0;k<count;++k)
+            x[k] = base[indices[index+k]];
+        return model::load(x, size_t(0));
+    }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, size_t count, pack_type val) {
+        ARRR_ALIGN(64) value_type x[model::pack_size];
+        model::store(x, size_t(0), val);
+        for(size_t k = 0;k<count;++k)
+            base[indices[index+k]] = x[k];
+    }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, size_t count, pack_type val) {
+        ARRR_ALIGN(64) value_type x[model::pack_size];
+        model::store(x, size_t(0), val);
+        for(size_t k = 0;k<count;++k)
+            base[indices[index+k]] = scalar_instruction_set<value_type>::template binary<add_tag>(base[indices[index+k]], x[k]);
+    }
+};
+
+
+// strided_lanes does the same for elements that are stride apart
+template<typename model>
+struct strided_lanes {
+    typedef typename model::value_type value_type;
+    typedef typename model::pack_type pack_type;
+    static pack_type load(const value_type *ptr, size_t stride, size_t count) {
+        ARRR_ALIGN(64) value_type x[model::pack_size] = { };
+        for(size_t k = 0;k<count;++k)
+            x[k] = ptr[k*stride];
+        return model::load(x, size_t(0));
+    }
+    static void store(value_type *ptr, size_t stride, size_t count, pack_type val) {
+        ARRR_ALIGN(64) value_type x[model::pack_size];
+        model::store(x, size_t(0), val);
+        for(size_t k = 0;k<count;++k)
+            ptr[k*stride] = x[k];
+    }
+};
+
+// transposed_lanes transposes a square block of pack_size rows in memory
+// for the instruction sets without a shuffle sequence for it. It only
+// touches elements so it is safe to call from any target.
+template<typename T, size_t W>
+struct transposed_lanes {
+    static void transpose(T *x) {
+        for(size_t r = 0;r<W;++r)
+            for(size_t k = r+1;k<W;++k)
+                std::swap(x[r*W+k], x[k*W+r]);
+    }
+};
+
+// integer element types that the vector instruction sets handle
+template<typename T>
+struct is_vector_integer : public std::integral_constant<bool, std::is_integral<T>::value && !std::is_same<T, bool>::value> { };
+
+// Every instruction set lives in a namespace named after the extension it
+// needs. Normally only the ones enabled on the command line are defined and
+// vector_instruction_set is the widest of them. With ARRR_DISPATCH all of
+// them are compiled for their own target and vector_instruction_set becomes
+// a placeholder that dispatch.hpp resolves at runtime.
+
+#if defined(ARRR_DISPATCH) || defined(__SSE2__)
+#if defined(ARRR_DISPATCH)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+namespace sse2 {
+
+// integer_instruction_set handles every integer element type in one
+// register type. add, sub and mul wrap around, min and max respect the
+// signedness of T. Operations without an integer instruction (div, sqrt,
+// rsqrt, rcp and 64 bit min/max) are evaluated lane by lane with exactly
+// the semantics of scalar_instruction_set.
+template<typename T>
+struct integer_instruction_set {
+    typedef T value_type;
+    typedef __m128i pack_type;
+    static const size_t pack_size = 16/sizeof(T);
+    static const size_t alignment = 16;
+    static const size_t registers = 8;
+    static const bool masked_tail = false;
+
+    template<typename T2>
+    static pack_type set(T2 value) { return splat(value_type(value), lane_type()); }
+    static pack_type load(const value_type *ptr, size_t index) { return _mm_load_si128(reinterpret_cast<const __m128i*>(ptr+index)); }
+    static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm_store_si128(reinterpret_cast<__m128i*>(ptr+index), val); return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr+index)); }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr+index), val); return val; }
+    static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm_stream_si128(reinterpret_cast<__m128i*>(ptr+index), val); return val; }
+    static void fence() { _mm_sfence(); }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+    // sse2 has no gather or scatter instructions
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return indexed_lanes<integer_instruction_set>::gather(base, indices, index, pack_size); }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<integer_instruction_set>::scatter(base, indices, index, pack_size, val); }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<integer_instruction_set>::scatter_add(base, indices, index, pack_size, val); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return strided_lanes<integer_instruction_set>::load(ptr+index*stride, stride, pack_size); }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { strided_lanes<integer_instruction_set>::store(ptr+index*stride, stride, pack_size, val); }
+    static void transpose(pack_type *rows) {
+        ARRR_ALIGN(64) value_type x[pack_size*pack_size];
+        for(size_t r = 0;r<pack_size;++r)
+            store(x, r*pack_size, rows[r]);
+        transposed_lanes<value_type,pack_size>::transpose(x);
+        for(size_t r = 0;r<pack_size;++r)
+            rows[r] = load(x, r*pack_size);
+    }
+
+    // lane<bytes, is_signed> selects the instructions for the element type
+    template<size_t bytes, bool is_signed> struct lane { };
+    typedef lane<sizeof(T), std::is_signed<T>::value> lane_type;
+
+    template<bool S> static pack_type splat(value_type a, lane<1,S>) { return _mm_set1_epi8(char(a)); }
+    template<bool S> static pack_type splat(value_type a, lane<2,S>) { return _mm_set1_epi16(short(a)); }
+    template<bool S> static pack_type splat(value_type a, lane<4,S>) { return _mm_set1_epi32(int(a)); }
+    template<bool S> static pack_type splat(value_type a, lane<8,S>) { return _mm_set1_epi64x((long long)(a)); }
+
+    template<bool S> static pack_type add(pack_type a, pack_type b, lane<1,S>) { return _mm_add_epi8(a, b); }
+    template<bool S> static pack_type add(pack_type a, pack_type b, lane<2,S>) { return _mm_add_epi16(a, b); }
+    template<bool S> static pack_type add(pack_type a, pack_type b, lane<4,S>) { return _mm_add_epi32(a, b); }
+    template<bool S> static pack_type add(pack_type a, pack_type b, lane<8,S>) { return _mm_add_epi64(a, b); }
+
+    template<bool S> static pack_type sub(pack_type a, pack_type b, lane<1,S>) { return _mm_sub_epi8(a, b); }
+    template<bool S> static pack_type sub(pack_type a, pack_type b, lane<2,S>) { return _mm_sub_epi16(a, b); }
+    template<bool S> static pack_type sub(pack_type a, pack_type b, lane<4,S>) { return _mm_sub_epi32(a, b); }
+    template<bool S> static pack_type sub(pack_type a, pack_type b, lane<8,S>) { return _mm_sub_epi64(a, b); }
+
+    // only 16 bit products exist, the other widths are put together from
+    // 16 bit and 32x32->64 bit multiplies
+    template<bool S> static pack_type mul(pack_type a, pack_type b, lane<1,S>) {
+        const pack_type even = _mm_mullo_epi16(a, b);
+        const pack_type odd = _mm_mullo_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        return _mm_or_si128(_mm_and_si128(even, _mm_set1_epi16(0xff)), _mm_slli_epi16(odd, 8));
+    }
+    template<bool S> static pack_type mul(pack_type a, pack_type b, lane<2,S>) { return _mm_mullo_epi16(a, b); }
+    template<bool S> static pack_type mul(pack_type a, pack_type b, lane<4,S>) {
+        const pack_type even = _mm_mul_epu32(a, b);
+        const pack_type odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+    }
+    template<bool S> static pack_type mul(pack_type a, pack_type b, lane<8,S>) {
+        const pack_type cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b), _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+        return _mm_add_epi64(_mm_mul_epu32(a, b), _mm_slli_epi64(cross, 32));
+    }
+
+    // compares only exist for signed lanes, unsigned ones flip the sign
+    // bit first. 64 bit compares are lanewise except for equality.
+    template<bool S> static pack_type equal(pack_type a, pack_type b, lane<1,S>) { return _mm_cmpeq_epi8(a, b); }
+    template<bool S> static pack_type equal(pack_type a, pack_type b, lane<2,S>) { return _mm_cmpeq_epi16(a, b); }
+    template<bool S> static pack_type equal(pack_type a, pack_type b, lane<4,S>) { return _mm_cmpeq_epi32(a, b); }
+    template<bool S> static pack_type equal(pack_type a, pack_type b, lane<8,S>) { const pack_type e = _mm_cmpeq_epi32(a, b); return _mm_and_si128(e, _mm_shuffle_epi32(e, _MM_SHUFFLE(2,3,0,1))); }
+    static pack_type greater(pack_type a, pack_type b, lane<1,true>) { return _mm_cmpgt_epi8(a, b); }
+    static pack_type greater(pack_type a, pack_type b, lane<2,true>) { return _mm_cmpgt_epi16(a, b); }
+    static pack_type greater(pack_type a, pack_type b, lane<4,true>) { return _mm_cmpgt_epi32(a, b); }
+    static pack_type greater(pack_type a, pack_type b, lane<1,false>) { const pack_type s = _mm_set1_epi8(char(0x80)); return _mm_cmpgt_epi8(_mm_xor_si128(a, s), _mm_xor_si128(b, s)); }
+    static pack_type greater(pack_type a, pack_type b, lane<2,false>) { const pack_type s = _mm_set1_epi16(short(0x8000)); return _mm_cmpgt_epi16(_mm_xor_si128(a, s), _mm_xor_si128(b, s)); }
+    static pack_type greater(pack_type a, pack_type b, lane<4,false>) { const pack_type s = _mm_set1_epi32(int(0x80000000u)); return _mm_cmpgt_epi32(_mm_xor_si128(a, s), _mm_xor_si128(b, s)); }
+    template<bool S> static pack_type greater(pack_type a, pack_type b, lane<8,S>) { return lanewise<gt_tag>(a, b); }
+    static pack_type invert(pack_type a) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }
+    static pack_type select(pack_type mask, pack_type a, pack_type b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+
+    // sse2 only has unsigned 8 bit and signed 16 bit min/max, the other
+    // signedness is mapped onto them by flipping the sign bit
+    static pack_type min(pack_type a, pack_type b, lane<1,false>) { return _mm_min_epu8(a, b); }
+    static pack_type max(pack_type a, pack_type b, lane<1,false>) { return _mm_max_epu8(a, b); }
+    static pack_type min(pack_type a, pack_type b, lane<1,true>) { const pack_type s = _mm_set1_epi8(char(0x80)); return _mm_xor_si128(_mm_min_epu8(_mm_xor_si128(a, s), _mm_xor_si128(b, s)), s); }
+    static pack_type max(pack_type a, pack_type b, lane<1,true>) { const pack_type s = _mm_set1_epi8(char(0x80)); return _mm_xor_si128(_mm_max_epu8(_mm_xor_si128(a, s), _mm_xor_si128(b, s)), s); }
+    static pack_type min(pack_type a, pack_type b, lane<2,true>) { return _mm_min_epi16(a, b); }
+    static pack_type max(pack_type a, pack_type b, lane<2,true>) { return _mm_max_epi16(a, b); }
+    static pack_type min(pack_type a, pack_type b, lane<2,false>) { const pack_type s = _mm_set1_epi16(short(0x8000)); return _mm_xor_si128(_mm_min_epi16(_mm_xor_si128(a, s), _mm_xor_si128(b, s)), s); }
+    static pack_type max(pack_type a, pack_type b, lane<2,false>) { const pack_type s = _mm_set1_epi16(short(0x8000)); return _mm_xor_si128(_mm_max_epi16(_mm_xor_si128(a, s), _mm_xor_si128(b, s)), s); }
+    template<bool S> static pack_type min(pack_type a, pack_type b, lane<4,S>) { return select(greater(a, b, lane_type()), b, a); }
+    template<bool S> static pack_type max(pack_type a, pack_type b, lane<4,S>) { return select(greater(a, b, lane_type()), a, b); }
+    template<bool S> static pack_type min(pack_type a, pack_type b, lane<8,S>) { return lanewise<min_tag>(a, b); }
+    template<bool S> static pack_type max(pack_type a, pack_type b, lane<8,S>) { return lanewise<max_tag>(a, b); }
+
+    template<class tag>
+    static pack_type lanewise(pack_type a) {
+        ARRR_ALIGN(16) value_type x[pack_size];
+        _mm_store_si128(reinterpret_cast<__m128i*>(x), a);
+        for(size_t k = 0;k<pack_size;++k)
+            x[k] = scalar_instruction_set<T>::template unary<tag>(x[k]);
+        return _mm_load_si128(reinterpret_cast<const __m128i*>(x));
+    }
+    template<class tag>
+    static pack_type lanewise(pack_type a, pack_type b) {
+        ARRR_ALIGN(16) value_type x[pack_size], y[pack_size];
+        _mm_store_si128(reinterpret_cast<__m128i*>(x), a);
+        _mm_store_si128(reinterpret_cast<__m128i*>(y), b);
+        for(size_t k = 0;k<pack_size;++k)
+            x[k] = scalar_instruction_set<T>::template binary<tag>(x[k], y[k]);
+        return _mm_load_si128(reinterpret_cast<const __m128i*>(x));
+    }
+
+    template<typename T2, typename tag> struct unary_op { T2 operator()(T2 a) { return lanewise<tag>(a); } };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return invert(a); } };
+
+    template<class tag>
+    static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
+
+    template<typename T2, typename tag> struct binary_op { T2 operator()(T2 a, T2 b) { return lanewise<tag>(a, b); } };
+    template<typename T2> struct binary_op<T2,add_tag> { T2 operator()(T2 a, T2 b) { return add(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,sub_tag> { T2 operator()(T2 a, T2 b) { return sub(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,mul_tag> { T2 operator()(T2 a, T2 b) { return mul(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return min(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return max(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return greater(b, a, lane_type()); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return invert(greater(a, b, lane_type())); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return greater(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return invert(greater(b, a, lane_type())); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return equal(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return invert(equal(a, b, lane_type())); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return _mm_and_si128(a, b); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return _mm_or_si128(a, b); } };
+
+    template<class tag>
+    static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return add(mul(a, b, lane_type()), c, lane_type()); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return sub(mul(a, b, lane_type()), c, lane_type()); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return sub(c, mul(a, b, lane_type()), lane_type()); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return select(a, b, c); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) {
+        ARRR_ALIGN(16) value_type x[pack_size];
+        _mm_store_si128(reinterpret_cast<__m128i*>(x), a);
+        value_type result = x[0];
+        for(size_t k = 1;k<pack_size;++k)
+            result = scalar_instruction_set<T>::template binary<tag>(result, x[k]);
+        return result;
+    }
+};
+
+template<typename T>
+struct instruction_set : public std::conditional<is_vector_integer<T>::value, integer_instruction_set<T>, scalar_instruction_set<T>>::type { };
+
+template<>
+struct instruction_set<float> {
+    typedef float value_type;
+    typedef __m128 pack_type;
+    static const size_t pack_size = 4;
+    static const size_t alignment = 16;
+    static const size_t registers = 8;
+    static const bool masked_tail = false;
+
+    template<typename T2>
+    static pack_type set(T2 value) { return _mm_set1_ps(value); }
+    static pack_type load(const value_type *ptr, size_t index) { return _mm_load_ps(ptr+index); }
+    static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm_store_ps(ptr+index, val); return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return _mm_loadu_ps(ptr+index); }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { _mm_storeu_ps(ptr+index, val); return val; }
+    static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm_stream_ps(ptr+index, val); return val; }
+    static void fence() { _mm_sfence(); }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return indexed_lanes<instruction_set>::gather(base, indices, index, pack_size); }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter(base, indices, index, pack_size, val); }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index, pack_size, val); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) {
+        const value_type *p = ptr+index*stride;
+        return _mm_setr_ps(p[0], p[stride], p[2*stride], p[3*stride]);
+    }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { strided_lanes<instruction_set>::store(ptr+index*stride, stride, pack_size, val); }
+    static void transpose(pack_type *rows) { _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]); }
+    static pack_type even(pack_type a, pack_type b) { return _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)); }
+    static pack_type odd(pack_type a, pack_type b) { return _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)); }
+    static pack_type interleave_low(pack_type a, pack_type b) { return _mm_unpacklo_ps(a, b); }
+    static pack_type interleave_high(pack_type a, pack_type b) { return _mm_unpackhi_ps(a, b); }
+    // convert narrows two packs of doubles into one pack
+    static pack_type convert(__m128d lo, __m128d hi) { return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)); }
+    // half has no conversion instructions before F16C and goes lane by lane,
+    // bfloat16 moves between the halves of the lanes
+    template<typename R> static pack_type widen(const basic_half<R> *ptr) { return _mm_setr_ps(ptr[0], ptr[1], ptr[2], ptr[3]); }
+    template<typename R> static void narrow(basic_half<R> *ptr, pack_type val) {
+        ARRR_ALIGN(16) float x[pack_size];
+        _mm_store_ps(x, val);
+        std::copy(x, x+pack_size, ptr);
+    }
+    template<typename R> static pack_type widen(const basic_bfloat16<R> *ptr) { return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(ptr)))); }
+    template<typename R> static void narrow(basic_bfloat16<R> *ptr, pack_type val) {
+        const __m128i x = bfloat16_bits<R>(val);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(ptr), _mm_packs_epi32(x, x));
+    }
+    // bfloat16_bits rounds to the upper halves and shifts them down sign
+    // extended, so they survive the saturating pack. NaNs stay quiet NaNs.
+    template<typename R> static __m128i bfloat16_bits(pack_type val) {
+        const __m128i bits = _mm_castps_si128(val), sign = _mm_srai_epi32(bits, 31), low = _mm_set1_epi32(0xffff);
+        __m128i bias = _mm_setzero_si128();
+        if(R::mode == round_to_nearest::mode)
+            bias = _mm_add_epi32(_mm_set1_epi32(0x7fff), _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1)));
+        else if(R::mode == round_down::mode)
+            bias = _mm_and_si128(sign, low);
+        else if(R::mode == round_up::mode)
+            bias = _mm_andnot_si128(sign, low);
+        const __m128i nan = _mm_castps_si128(_mm_cmpunord_ps(val, val));
+        const __m128i rounded = _mm_or_si128(_mm_andnot_si128(nan, _mm_add_epi32(bits, bias)), _mm_and_si128(nan, _mm_or_si128(bits, _mm_set1_epi32(0x400000))));
+        return _mm_srai_epi32(rounded, 16);
+    }
+    ARRR_FLOAT16_ACCESS
+    // the primitives of math.hpp. sse2 has no rounding instruction, adding
+    // and subtracting 1.5*2^23 rounds everything below 2^22 in magnitude
+    static pack_type round(pack_type a) { const pack_type magic = _mm_set1_ps(12582912.0f); return _mm_sub_ps(_mm_add_ps(a, magic), magic); }
+    static pack_type pow2(pack_type n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)); }
+    static pack_type exponent(pack_type a) { return _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(a), 23), _mm_set1_epi32(127))); }
+    static pack_type rsqrt_estimate(pack_type a) { return _mm_rsqrt_ps(a); }
+    static pack_type rcp_estimate(pack_type a) { return _mm_rcp_ps(a); }
+
+    template<typename T2, typename tag> struct unary_op { };
+    template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return _mm_sqrt_ps(a); } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rcp(a, P()); } };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1))); } };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::tanh(a); } };
+
+    template<class tag>
+    static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
+
+    template<typename T2, typename tag> struct binary_op { };
+    template<typename T2> struct binary_op<T2,add_tag> { T2 operator()(T2 a, T2 b) { return _mm_add_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,sub_tag> { T2 operator()(T2 a, T2 b) { return _mm_sub_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,mul_tag> { T2 operator()(T2 a, T2 b) { return _mm_mul_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return _mm_div_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return _mm_min_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return _mm_max_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmplt_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmple_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmpgt_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmpge_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmpeq_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmpneq_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return _mm_and_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return _mm_or_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<instruction_set>::pow(a, b); } };
+
+    template<class tag>
+    static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm_sub_ps(_mm_mul_ps(a, b), c); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm_or_ps(_mm_and_ps(a, b), _mm_andnot_ps(a, c)); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) {
+        a = binary<tag>(a, _mm_movehl_ps(a, a));
+        a = binary<tag>(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1,1,1,1)));
+        return _mm_cvtss_f32(a);
+    }
+};
+
+template<>
+struct instruction_set<double> {
+    typedef double value_type;
+    typedef __m128d pack_type;
+    static const size_t pack_size = 2;
+    static const size_t alignment = 16;
+    static const size_t registers = 8;
+    static const bool masked_tail = false;
+
+    template<typename T2>
+    static pack_type set(T2 value) { return _mm_set1_pd(value); }
+    static pack_type load(const value_type *ptr, size_t index) { return _mm_load_pd(ptr+index); }
+    static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm_store_pd(ptr+index, val); return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return _mm_loadu_pd(ptr+index); }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { _mm_storeu_pd(ptr+index, val); return val; }
+    static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm_stream_pd(ptr+index, val); return val; }
+    static void fence() { _mm_sfence(); }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return indexed_lanes<instruction_set>::gather(base, indices, index, pack_size); }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter(base, indices, index, pack_size, val); }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index, pack_size, val); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return _mm_loadh_pd(_mm_load_sd(ptr+index*stride), ptr+(index+1)*stride); }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { _mm_storel_pd(ptr+index*stride, val); _mm_storeh_pd(ptr+(index+1)*stride, val); }
+    static void transpose(pack_type *rows) {
+        const pack_type low = _mm_unpacklo_pd(rows[0], rows[1]);
+        rows[1] = _mm_unpackhi_pd(rows[0], rows[1]);
+        rows[0] = low;
+    }
+    static pack_type even(pack_type a, pack_type b) { return _mm_unpacklo_pd(a, b); }
+    static pack_type odd(pack_type a, pack_type b) { return _mm_unpackhi_pd(a, b); }
+    static pack_type interleave_low(pack_type a, pack_type b) { return _mm_unpacklo_pd(a, b); }
+    static pack_type interleave_high(pack_type a, pack_type b) { return _mm_unpackhi_pd(a, b); }
+    // convert widens two floats
+    static pack_type convert(float lo, float hi) { return _mm_cvtps_pd(_mm_setr_ps(lo, hi, 0.0f, 0.0f)); }
+    static pack_type round(pack_type a) { const pack_type magic = _mm_set1_pd(6755399441055744.0); return _mm_sub_pd(_mm_add_pd(a, magic), magic); }
+    static pack_type pow2(pack_type n) {
+        const __m128i e = _mm_add_epi32(_mm_cvtpd_epi32(n), _mm_set1_epi32(1023));
+        return _mm_castsi128_pd(_mm_slli_epi64(_mm_unpacklo_epi32(e, _mm_setzero_si128()), 52));
+    }
+    static pack_type exponent(pack_type a) {
+        const __m128i e = _mm_shuffle_epi32(_mm_srli_epi64(_mm_castpd_si128(a), 52), _MM_SHUFFLE(3,1,2,0));
+        return _mm_cvtepi32_pd(_mm_sub_epi32(e, _mm_set1_epi32(1023)));
+    }
+    // there are no double estimates, the float ones limit the fast
+    // precision to the float range
+    static pack_type rsqrt_estimate(pack_type a) { return _mm_cvtps_pd(_mm_rsqrt_ps(_mm_cvtpd_ps(a))); }
+    static pack_type rcp_estimate(pack_type a) { return _mm_cvtps_pd(_mm_rcp_ps(_mm_cvtpd_ps(a))); }
+
+    template<typename T2, typename tag> struct unary_op { };
+    template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return _mm_sqrt_pd(a); } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rcp(a, P()); } };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return _mm_xor_pd(a, _mm_castsi128_pd(_mm_set1_epi32(-1))); } };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::tanh(a); } };
+
+    template<class tag>
+    static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
+
+    template<typename T2, typename tag> struct binary_op { };
+    template<typename T2> struct binary_op<T2,add_tag> { T2 operator()(T2 a, T2 b) { return _mm_add_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,sub_tag> { T2 operator()(T2 a, T2 b) { return _mm_sub_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,mul_tag> { T2 operator()(T2 a, T2 b) { return _mm_mul_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return _mm_div_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return _mm_min_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return _mm_max_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmplt_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmple_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmpgt_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmpge_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmpeq_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return _mm_cmpneq_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return _mm_and_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return _mm_or_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<instruction_set>::pow(a, b); } };
 
     template<class tag>
     static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm_add_pd(_mm_mul_pd(a, b), c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm_sub_pd(_mm_mul_pd(a, b), c); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm_sub_pd(c, _mm_mul_pd(a, b)); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm_or_pd(_mm_and_pd(a, b), _mm_andnot_pd(a, c)); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) {
+        a = binary<tag>(a, _mm_unpackhi_pd(a, a));
+        return _mm_cvtsd_f64(a);
+    }
 };
+}
+#if defined(ARRR_DISPATCH)
+#pragma GCC pop_options
+#endif
+#endif
+
+#if defined(ARRR_DISPATCH) || defined(__AVX__)
+#if defined(ARRR_DISPATCH)
+#pragma GCC push_options
+#pragma GCC target("avx")
+#endif
+namespace avx {
 
+// avx has no 256 bit integer instructions
 template<typename T>
-struct vector_instruction_set : public scalar_instruction_set<T> { };
+struct instruction_set : public sse2::instruction_set<T> { };
 
-#if defined(__AVX__)
 template<>
-struct vector_instruction_set<float> {
+struct instruction_set<float> {
     typedef float value_type;
     typedef __m256 pack_type;
     static const size_t pack_size = 8;
     static const size_t alignment = 32;
     static const size_t registers = 16;
+    static const bool masked_tail = true;
 
     template<typename T2>
     static pack_type set(T2 value) { return _mm256_set1_ps(value); }
     static pack_type load(const value_type *ptr, size_t index) { return _mm256_load_ps(ptr+index); }
     static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm256_store_ps(ptr+index, val); return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return _mm256_loadu_ps(ptr+index); }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { _mm256_storeu_ps(ptr+index, val); return val; }
     static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm256_stream_ps(ptr+index, val); return val; }
+    static void fence() { _mm_sfence(); }
+
+    // masked_index addresses the first count elements starting at index
+    struct masked_index { size_t index; __m256i mask; };
+    static masked_index mask(size_t index, size_t count) { masked_index result = { index, _mm256_castps_si256(_mm256_cmp_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps(float(count)), _CMP_LT_OQ)) }; return result; }
+    static pack_type load(const value_type *ptr, const masked_index &index) { return _mm256_maskload_ps(ptr+index.index, index.mask); }
+    static pack_type store(value_type *ptr, const masked_index &index, pack_type val) { _mm256_maskstore_ps(ptr+index.index, index.mask, val); return val; }
+    static pack_type loadu(const value_type *ptr, const masked_index &index) { return load(ptr, index); }
+    static pack_type storeu(value_type *ptr, const masked_index &index, pack_type val) { return store(ptr, index, val); }
+    static pack_type stream(value_type *ptr, const masked_index &index, pack_type val) { _mm256_maskstore_ps(ptr+index.index, index.mask, val); return val; }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+    static pack_type blend_tail(pack_type a, pack_type fill, const masked_index &index) { return _mm256_blendv_ps(fill, a, _mm256_castsi256_ps(index.mask)); }
+    // avx has no gather or scatter instructions
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return indexed_lanes<instruction_set>::gather(base, indices, index, pack_size); }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter(base, indices, index, pack_size, val); }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index, pack_size, val); }
+    static size_t lanes(const masked_index &index) { return size_t(__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(index.mask)))); }
+    static pack_type gather(const value_type *base, const int32_t *indices, const masked_index &index) { return indexed_lanes<instruction_set>::gather(base, indices, index.index, lanes(index)); }
+    static void scatter(value_type *base, const int32_t *indices, const masked_index &index, pack_type val) { indexed_lanes<instruction_set>::scatter(base, indices, index.index, lanes(index), val); }
+    static void scatter_add(value_type *base, const int32_t *indices, const masked_index &index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index.index, lanes(index), val); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) {
+        const value_type *p = ptr+index*stride;
+        return _mm256_setr_ps(p[0], p[stride], p[2*stride], p[3*stride], p[4*stride], p[5*stride], p[6*stride], p[7*stride]);
+    }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { strided_lanes<instruction_set>::store(ptr+index*stride, stride, pack_size, val); }
+    static pack_type load_strided(const value_type *ptr, const masked_index &index, size_t stride) { return strided_lanes<instruction_set>::load(ptr+index.index*stride, stride, lanes(index)); }
+    static void store_strided(value_type *ptr, const masked_index &index, size_t stride, pack_type val) { strided_lanes<instruction_set>::store(ptr+index.index*stride, stride, lanes(index), val); }
+    // transpose interleaves pairs of rows, then pairs of pairs inside the
+    // 128 bit halves and finally swaps the halves
+    static void transpose(pack_type *rows) {
+        pack_type t[8], u[8];
+        for(int k = 0;k<8;k += 2) {
+            t[k] = _mm256_unpacklo_ps(rows[k], rows[k+1]);
+            t[k+1] = _mm256_unpackhi_ps(rows[k], rows[k+1]);
+        }
+        for(int k = 0;k<8;k += 4) {
+            u[k] = _mm256_shuffle_ps(t[k], t[k+2], _MM_SHUFFLE(1, 0, 1, 0));
+            u[k+1] = _mm256_shuffle_ps(t[k], t[k+2], _MM_SHUFFLE(3, 2, 3, 2));
+            u[k+2] = _mm256_shuffle_ps(t[k+1], t[k+3], _MM_SHUFFLE(1, 0, 1, 0));
+            u[k+3] = _mm256_shuffle_ps(t[k+1], t[k+3], _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        for(int k = 0;k<4;++k) {
+            rows[k] = _mm256_permute2f128_ps(u[k], u[k+4], 0x20);
+            rows[k+4] = _mm256_permute2f128_ps(u[k], u[k+4], 0x31);
+        }
+    }
+    // even and odd gather the halves of a and b by element position first,
+    // the interleaves merge within the halves and put them in order after
+    static pack_type even(pack_type a, pack_type b) { return _mm256_shuffle_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31), _MM_SHUFFLE(2, 0, 2, 0)); }
+    static pack_type odd(pack_type a, pack_type b) { return _mm256_shuffle_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31), _MM_SHUFFLE(3, 1, 3, 1)); }
+    static pack_type interleave_low(pack_type a, pack_type b) { return _mm256_permute2f128_ps(_mm256_unpacklo_ps(a, b), _mm256_unpackhi_ps(a, b), 0x20); }
+    static pack_type interleave_high(pack_type a, pack_type b) { return _mm256_permute2f128_ps(_mm256_unpacklo_ps(a, b), _mm256_unpackhi_ps(a, b), 0x31); }
+    static pack_type convert(__m256d lo, __m256d hi) { return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1); }
+    // half needs F16C, which the dispatched avx code does not assume.
+    // bfloat16 is widened and narrowed in 128 bit halves.
+#if defined(__F16C__)
+    template<typename R> static pack_type widen(const basic_half<R> *ptr) { return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr))); }
+    template<typename R> static void narrow(basic_half<R> *ptr, pack_type val) { _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), _mm256_cvtps_ph(val, R::mode)); }
+#else
+    template<typename R> static pack_type widen(const basic_half<R> *ptr) { return _mm256_setr_ps(ptr[0], ptr[1], ptr[2], ptr[3], ptr[4], ptr[5], ptr[6], ptr[7]); }
+    template<typename R> static void narrow(basic_half<R> *ptr, pack_type val) {
+        ARRR_ALIGN(32) float x[pack_size];
+        _mm256_store_ps(x, val);
+        std::copy(x, x+pack_size, ptr);
+    }
+#endif
+    template<typename R> static pack_type widen(const basic_bfloat16<R> *ptr) {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        const __m128 lo = _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), h)), hi = _mm_castsi128_ps(_mm_unpackhi_epi16(_mm_setzero_si128(), h));
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+    }
+    template<typename R> static void narrow(basic_bfloat16<R> *ptr, pack_type val) {
+        typedef sse2::instruction_set<float> half_model;
+        const __m128i lo = half_model::bfloat16_bits<R>(_mm256_castps256_ps128(val)), hi = half_model::bfloat16_bits<R>(_mm256_extractf128_ps(val, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), _mm_packs_epi32(lo, hi));
+    }
+    ARRR_FLOAT16_ACCESS
+    ARRR_FLOAT16_MASKED_ACCESS
+    // without avx2 the integer parts are done in 128 bit halves
+    static pack_type round(pack_type a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static pack_type pow2(pack_type n) {
+        const __m256i e = _mm256_cvtps_epi32(n);
+        const __m128i bias = _mm_set1_epi32(127);
+        const __m128i lo = _mm_slli_epi32(_mm_add_epi32(_mm256_castsi256_si128(e), bias), 23);
+        const __m128i hi = _mm_slli_epi32(_mm_add_epi32(_mm256_extractf128_si256(e, 1), bias), 23);
+        return _mm256_castsi256_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+    }
+    static pack_type exponent(pack_type a) {
+        const __m256i e = _mm256_castps_si256(a);
+        const __m128i bias = _mm_set1_epi32(127);
+        const __m128i lo = _mm_sub_epi32(_mm_srli_epi32(_mm256_castsi256_si128(e), 23), bias);
+        const __m128i hi = _mm_sub_epi32(_mm_srli_epi32(_mm256_extractf128_si256(e, 1), 23), bias);
+        return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+    }
+    static pack_type rsqrt_estimate(pack_type a) { return _mm256_rsqrt_ps(a); }
+    static pack_type rcp_estimate(pack_type a) { return _mm256_rcp_ps(a); }
 
     template<typename T2, typename tag> struct unary_op { };
     template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return _mm256_sqrt_ps(a); } };
-    template<typename T2> struct unary_op<T2,rsqrt_tag> { T2 operator()(T2 a) { return _mm256_rsqrt_ps(a); } };
-    template<typename T2> struct unary_op<T2,rcp_tag> { T2 operator()(T2 a) { return _mm256_rcp_ps(a); } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rcp(a, P()); } };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); } };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::tanh(a); } };
 
     template<class tag>
     static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
@@ -67,29 +744,118 @@ struct vector_instruction_set<float> {
     template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return _mm256_div_ps(a, b); } };
     template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return _mm256_min_ps(a, b); } };
     template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return _mm256_max_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return _mm256_and_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return _mm256_or_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<instruction_set>::pow(a, b); } };
 
     template<class tag>
     static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_sub_ps(_mm256_mul_ps(a, b), c); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_sub_ps(c, _mm256_mul_ps(a, b)); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_blendv_ps(c, b, a); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) {
+        a = binary<tag>(a, _mm256_permute2f128_ps(a, a, 1));
+        a = binary<tag>(a, _mm256_permute_ps(a, _MM_SHUFFLE(1,0,3,2)));
+        a = binary<tag>(a, _mm256_permute_ps(a, _MM_SHUFFLE(2,3,0,1)));
+        return _mm_cvtss_f32(_mm256_castps256_ps128(a));
+    }
 };
 
 template<>
-struct vector_instruction_set<double> {
+struct instruction_set<double> {
     typedef double value_type;
     typedef __m256d pack_type;
     static const size_t pack_size = 4;
     static const size_t alignment = 32;
     static const size_t registers = 16;
+    static const bool masked_tail = true;
 
     template<typename T2>
     static pack_type set(T2 value) { return _mm256_set1_pd(value); }
     static pack_type load(const value_type *ptr, size_t index) { return _mm256_load_pd(ptr+index); }
     static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm256_store_pd(ptr+index, val); return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return _mm256_loadu_pd(ptr+index); }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { _mm256_storeu_pd(ptr+index, val); return val; }
     static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm256_stream_pd(ptr+index, val); return val; }
+    static void fence() { _mm_sfence(); }
+
+    // masked_index addresses the first count elements starting at index
+    struct masked_index { size_t index; __m256i mask; };
+    static masked_index mask(size_t index, size_t count) { masked_index result = { index, _mm256_castpd_si256(_mm256_cmp_pd(_mm256_setr_pd(0, 1, 2, 3), _mm256_set1_pd(double(count)), _CMP_LT_OQ)) }; return result; }
+    static pack_type load(const value_type *ptr, const masked_index &index) { return _mm256_maskload_pd(ptr+index.index, index.mask); }
+    static pack_type store(value_type *ptr, const masked_index &index, pack_type val) { _mm256_maskstore_pd(ptr+index.index, index.mask, val); return val; }
+    static pack_type loadu(const value_type *ptr, const masked_index &index) { return load(ptr, index); }
+    static pack_type storeu(value_type *ptr, const masked_index &index, pack_type val) { return store(ptr, index, val); }
+    static pack_type stream(value_type *ptr, const masked_index &index, pack_type val) { _mm256_maskstore_pd(ptr+index.index, index.mask, val); return val; }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+    static pack_type blend_tail(pack_type a, pack_type fill, const masked_index &index) { return _mm256_blendv_pd(fill, a, _mm256_castsi256_pd(index.mask)); }
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return indexed_lanes<instruction_set>::gather(base, indices, index, pack_size); }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter(base, indices, index, pack_size, val); }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index, pack_size, val); }
+    static size_t lanes(const masked_index &index) { return size_t(__builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(index.mask)))); }
+    static pack_type gather(const value_type *base, const int32_t *indices, const masked_index &index) { return indexed_lanes<instruction_set>::gather(base, indices, index.index, lanes(index)); }
+    static void scatter(value_type *base, const int32_t *indices, const masked_index &index, pack_type val) { indexed_lanes<instruction_set>::scatter(base, indices, index.index, lanes(index), val); }
+    static void scatter_add(value_type *base, const int32_t *indices, const masked_index &index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index.index, lanes(index), val); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) {
+        const value_type *p = ptr+index*stride;
+        return _mm256_setr_pd(p[0], p[stride], p[2*stride], p[3*stride]);
+    }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { strided_lanes<instruction_set>::store(ptr+index*stride, stride, pack_size, val); }
+    static pack_type load_strided(const value_type *ptr, const masked_index &index, size_t stride) { return strided_lanes<instruction_set>::load(ptr+index.index*stride, stride, lanes(index)); }
+    static void store_strided(value_type *ptr, const masked_index &index, size_t stride, pack_type val) { strided_lanes<instruction_set>::store(ptr+index.index*stride, stride, lanes(index), val); }
+    static void transpose(pack_type *rows) {
+        const pack_type t0 = _mm256_unpacklo_pd(rows[0], rows[1]), t1 = _mm256_unpackhi_pd(rows[0], rows[1]);
+        const pack_type t2 = _mm256_unpacklo_pd(rows[2], rows[3]), t3 = _mm256_unpackhi_pd(rows[2], rows[3]);
+        rows[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+        rows[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+        rows[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+        rows[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+    }
+    static pack_type even(pack_type a, pack_type b) { return _mm256_unpacklo_pd(_mm256_permute2f128_pd(a, b, 0x20), _mm256_permute2f128_pd(a, b, 0x31)); }
+    static pack_type odd(pack_type a, pack_type b) { return _mm256_unpackhi_pd(_mm256_permute2f128_pd(a, b, 0x20), _mm256_permute2f128_pd(a, b, 0x31)); }
+    static pack_type interleave_low(pack_type a, pack_type b) { return _mm256_permute2f128_pd(_mm256_unpacklo_pd(a, b), _mm256_unpackhi_pd(a, b), 0x20); }
+    static pack_type interleave_high(pack_type a, pack_type b) { return _mm256_permute2f128_pd(_mm256_unpacklo_pd(a, b), _mm256_unpackhi_pd(a, b), 0x31); }
+    static pack_type convert(__m128 a) { return _mm256_cvtps_pd(a); }
+    static pack_type round(pack_type a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static pack_type pow2(pack_type n) {
+        const __m128i e = _mm_add_epi32(_mm256_cvtpd_epi32(n), _mm_set1_epi32(1023));
+        const __m128i lo = _mm_slli_epi64(_mm_unpacklo_epi32(e, _mm_setzero_si128()), 52);
+        const __m128i hi = _mm_slli_epi64(_mm_unpackhi_epi32(e, _mm_setzero_si128()), 52);
+        return _mm256_castsi256_pd(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+    }
+    static pack_type exponent(pack_type a) {
+        const __m256i e = _mm256_castpd_si256(a);
+        const __m128i lo = _mm_shuffle_epi32(_mm_srli_epi64(_mm256_castsi256_si128(e), 52), _MM_SHUFFLE(3,1,2,0));
+        const __m128i hi = _mm_shuffle_epi32(_mm_srli_epi64(_mm256_extractf128_si256(e, 1), 52), _MM_SHUFFLE(3,1,2,0));
+        return _mm256_cvtepi32_pd(_mm_sub_epi32(_mm_unpacklo_epi64(lo, hi), _mm_set1_epi32(1023)));
+    }
+    static pack_type rsqrt_estimate(pack_type a) { return _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(a))); }
+    static pack_type rcp_estimate(pack_type a) { return _mm256_cvtps_pd(_mm_rcp_ps(_mm256_cvtpd_ps(a))); }
 
     template<typename T2, typename tag> struct unary_op { };
     template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return _mm256_sqrt_pd(a); } };
-    template<typename T2> struct unary_op<T2,rsqrt_tag> { T2 operator()(T2 a) { return _mm256_rsqrt_pd(a); } };
-    template<typename T2> struct unary_op<T2,rcp_tag> { T2 operator()(T2 a) { return _mm256_rcp_pd(a); } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rcp(a, P()); } };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return _mm256_xor_pd(a, _mm256_castsi256_pd(_mm256_set1_epi32(-1))); } };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::tanh(a); } };
 
     template<class tag>
     static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
@@ -101,76 +867,667 @@ struct vector_instruction_set<double> {
     template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return _mm256_div_pd(a, b); } };
     template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return _mm256_min_pd(a, b); } };
     template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return _mm256_max_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return _mm256_and_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return _mm256_or_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<instruction_set>::pow(a, b); } };
 
     template<class tag>
     static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_sub_pd(_mm256_mul_pd(a, b), c); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_sub_pd(c, _mm256_mul_pd(a, b)); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_blendv_pd(c, b, a); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) {
+        a = binary<tag>(a, _mm256_permute2f128_pd(a, a, 1));
+        a = binary<tag>(a, _mm256_permute_pd(a, 5));
+        return _mm_cvtsd_f64(_mm256_castpd256_pd128(a));
+    }
 };
-#elif defined(__SSE2__)
+}
+#if defined(ARRR_DISPATCH)
+#pragma GCC pop_options
+#endif
+#endif
+
+#if defined(ARRR_DISPATCH) || defined(__AVX2__)
+#if defined(ARRR_DISPATCH)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,f16c")
+#endif
+namespace avx2 {
+
+// integer_instruction_set follows sse2::integer_instruction_set with twice
+// the width. avx2 has min/max for all widths up to 32 bit and a 32 bit
+// multiply, 64 bit min/max use a compare and blend.
+template<typename T>
+struct integer_instruction_set {
+    typedef T value_type;
+    typedef __m256i pack_type;
+    static const size_t pack_size = 32/sizeof(T);
+    static const size_t alignment = 32;
+    static const size_t registers = 16;
+    static const bool masked_tail = false;
+
+    template<typename T2>
+    static pack_type set(T2 value) { return splat(value_type(value), lane_type()); }
+    static pack_type load(const value_type *ptr, size_t index) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(ptr+index)); }
+    static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm256_store_si256(reinterpret_cast<__m256i*>(ptr+index), val); return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr+index)); }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr+index), val); return val; }
+    static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm256_stream_si256(reinterpret_cast<__m256i*>(ptr+index), val); return val; }
+    static void fence() { _mm_sfence(); }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+
+    // lane<bytes, is_signed> selects the instructions for the element type
+    template<size_t bytes, bool is_signed> struct lane { };
+    typedef lane<sizeof(T), std::is_signed<T>::value> lane_type;
+
+    // 32 and 64 bit elements are gathered with avx2 instructions, scatters
+    // and narrower elements go lane by lane
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return gather(base, indices, index, lane_type()); }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<integer_instruction_set>::scatter(base, indices, index, pack_size, val); }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<integer_instruction_set>::scatter_add(base, indices, index, pack_size, val); }
+    template<size_t bytes, bool S> static pack_type gather(const value_type *base, const int32_t *indices, size_t index, lane<bytes,S>) { return indexed_lanes<integer_instruction_set>::gather(base, indices, index, pack_size); }
+    template<bool S> static pack_type gather(const value_type *base, const int32_t *indices, size_t index, lane<4,S>) { return _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices+index)), 4); }
+    template<bool S> static pack_type gather(const value_type *base, const int32_t *indices, size_t index, lane<8,S>) { return _mm256_i32gather_epi64(reinterpret_cast<const long long*>(base), _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices+index)), 8); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return load_strided(ptr+index*stride, stride, lane_type()); }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { strided_lanes<integer_instruction_set>::store(ptr+index*stride, stride, pack_size, val); }
+    static void transpose(pack_type *rows) {
+        ARRR_ALIGN(64) value_type x[pack_size*pack_size];
+        for(size_t r = 0;r<pack_size;++r)
+            store(x, r*pack_size, rows[r]);
+        transposed_lanes<value_type,pack_size>::transpose(x);
+        for(size_t r = 0;r<pack_size;++r)
+            rows[r] = load(x, r*pack_size);
+    }
+    template<size_t bytes, bool S> static pack_type load_strided(const value_type *ptr, size_t stride, lane<bytes,S>) { return strided_lanes<integer_instruction_set>::load(ptr, stride, pack_size); }
+    template<bool S> static pack_type load_strided(const value_type *ptr, size_t stride, lane<4,S>) {
+        return _mm256_i32gather_epi32(reinterpret_cast<const int*>(ptr), _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int(stride))), 4);
+    }
+    template<bool S> static pack_type load_strided(const value_type *ptr, size_t stride, lane<8,S>) {
+        return _mm256_i32gather_epi64(reinterpret_cast<const long long*>(ptr), _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(int(stride))), 8);
+    }
+
+    template<bool S> static pack_type splat(value_type a, lane<1,S>) { return _mm256_set1_epi8(char(a)); }
+    template<bool S> static pack_type splat(value_type a, lane<2,S>) { return _mm256_set1_epi16(short(a)); }
+    template<bool S> static pack_type splat(value_type a, lane<4,S>) { return _mm256_set1_epi32(int(a)); }
+    template<bool S> static pack_type splat(value_type a, lane<8,S>) { return _mm256_set1_epi64x((long long)(a)); }
+
+    template<bool S> static pack_type add(pack_type a, pack_type b, lane<1,S>) { return _mm256_add_epi8(a, b); }
+    template<bool S> static pack_type add(pack_type a, pack_type b, lane<2,S>) { return _mm256_add_epi16(a, b); }
+    template<bool S> static pack_type add(pack_type a, pack_type b, lane<4,S>) { return _mm256_add_epi32(a, b); }
+    template<bool S> static pack_type add(pack_type a, pack_type b, lane<8,S>) { return _mm256_add_epi64(a, b); }
+
+    template<bool S> static pack_type sub(pack_type a, pack_type b, lane<1,S>) { return _mm256_sub_epi8(a, b); }
+    template<bool S> static pack_type sub(pack_type a, pack_type b, lane<2,S>) { return _mm256_sub_epi16(a, b); }
+    template<bool S> static pack_type sub(pack_type a, pack_type b, lane<4,S>) { return _mm256_sub_epi32(a, b); }
+    template<bool S> static pack_type sub(pack_type a, pack_type b, lane<8,S>) { return _mm256_sub_epi64(a, b); }
+
+    template<bool S> static pack_type mul(pack_type a, pack_type b, lane<1,S>) {
+        const pack_type even = _mm256_mullo_epi16(a, b);
+        const pack_type odd = _mm256_mullo_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        return _mm256_or_si256(_mm256_and_si256(even, _mm256_set1_epi16(0xff)), _mm256_slli_epi16(odd, 8));
+    }
+    template<bool S> static pack_type mul(pack_type a, pack_type b, lane<2,S>) { return _mm256_mullo_epi16(a, b); }
+    template<bool S> static pack_type mul(pack_type a, pack_type b, lane<4,S>) { return _mm256_mullo_epi32(a, b); }
+    template<bool S> static pack_type mul(pack_type a, pack_type b, lane<8,S>) {
+        const pack_type cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+        return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+    }
+
+    static pack_type min(pack_type a, pack_type b, lane<1,true>) { return _mm256_min_epi8(a, b); }
+    static pack_type max(pack_type a, pack_type b, lane<1,true>) { return _mm256_max_epi8(a, b); }
+    static pack_type min(pack_type a, pack_type b, lane<1,false>) { return _mm256_min_epu8(a, b); }
+    static pack_type max(pack_type a, pack_type b, lane<1,false>) { return _mm256_max_epu8(a, b); }
+    static pack_type min(pack_type a, pack_type b, lane<2,true>) { return _mm256_min_epi16(a, b); }
+    static pack_type max(pack_type a, pack_type b, lane<2,true>) { return _mm256_max_epi16(a, b); }
+    static pack_type min(pack_type a, pack_type b, lane<2,false>) { return _mm256_min_epu16(a, b); }
+    static pack_type max(pack_type a, pack_type b, lane<2,false>) { return _mm256_max_epu16(a, b); }
+    static pack_type min(pack_type a, pack_type b, lane<4,true>) { return _mm256_min_epi32(a, b); }
+    static pack_type max(pack_type a, pack_type b, lane<4,true>) { return _mm256_max_epi32(a, b); }
+    static pack_type min(pack_type a, pack_type b, lane<4,false>) { return _mm256_min_epu32(a, b); }
+    static pack_type max(pack_type a, pack_type b, lane<4,false>) { return _mm256_max_epu32(a, b); }
+    template<bool S> static pack_type min(pack_type a, pack_type b, lane<8,S>) { return select(greater(a, b, lane_type()), b, a); }
+    template<bool S> static pack_type max(pack_type a, pack_type b, lane<8,S>) { return select(greater(a, b, lane_type()), a, b); }
+
+    // compares only exist for signed lanes, unsigned ones flip the sign bit first
+    template<bool S> static pack_type equal(pack_type a, pack_type b, lane<1,S>) { return _mm256_cmpeq_epi8(a, b); }
+    template<bool S> static pack_type equal(pack_type a, pack_type b, lane<2,S>) { return _mm256_cmpeq_epi16(a, b); }
+    template<bool S> static pack_type equal(pack_type a, pack_type b, lane<4,S>) { return _mm256_cmpeq_epi32(a, b); }
+    template<bool S> static pack_type equal(pack_type a, pack_type b, lane<8,S>) { return _mm256_cmpeq_epi64(a, b); }
+    static pack_type greater(pack_type a, pack_type b, lane<1,true>) { return _mm256_cmpgt_epi8(a, b); }
+    static pack_type greater(pack_type a, pack_type b, lane<2,true>) { return _mm256_cmpgt_epi16(a, b); }
+    static pack_type greater(pack_type a, pack_type b, lane<4,true>) { return _mm256_cmpgt_epi32(a, b); }
+    static pack_type greater(pack_type a, pack_type b, lane<8,true>) { return _mm256_cmpgt_epi64(a, b); }
+    static pack_type greater(pack_type a, pack_type b, lane<1,false>) { const pack_type s = _mm256_set1_epi8(char(0x80)); return _mm256_cmpgt_epi8(_mm256_xor_si256(a, s), _mm256_xor_si256(b, s)); }
+    static pack_type greater(pack_type a, pack_type b, lane<2,false>) { const pack_type s = _mm256_set1_epi16(short(0x8000)); return _mm256_cmpgt_epi16(_mm256_xor_si256(a, s), _mm256_xor_si256(b, s)); }
+    static pack_type greater(pack_type a, pack_type b, lane<4,false>) { const pack_type s = _mm256_set1_epi32(int(0x80000000u)); return _mm256_cmpgt_epi32(_mm256_xor_si256(a, s), _mm256_xor_si256(b, s)); }
+    static pack_type greater(pack_type a, pack_type b, lane<8,false>) { const pack_type s = _mm256_set1_epi64x((long long)(0x8000000000000000ull)); return _mm256_cmpgt_epi64(_mm256_xor_si256(a, s), _mm256_xor_si256(b, s)); }
+    static pack_type invert(pack_type a) { return _mm256_xor_si256(a, _mm256_set1_epi32(-1)); }
+    // not a blendv: gcc 12 folds a negated mask into it wrongly when avx-512 is enabled
+    static pack_type select(pack_type mask, pack_type a, pack_type b) { return _mm256_or_si256(_mm256_and_si256(mask, a), _mm256_andnot_si256(mask, b)); }
+
+    template<class tag>
+    static pack_type lanewise(pack_type a) {
+        ARRR_ALIGN(32) value_type x[pack_size];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(x), a);
+        for(size_t k = 0;k<pack_size;++k)
+            x[k] = scalar_instruction_set<T>::template unary<tag>(x[k]);
+        return _mm256_load_si256(reinterpret_cast<const __m256i*>(x));
+    }
+    template<class tag>
+    static pack_type lanewise(pack_type a, pack_type b) {
+        ARRR_ALIGN(32) value_type x[pack_size], y[pack_size];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(x), a);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(y), b);
+        for(size_t k = 0;k<pack_size;++k)
+            x[k] = scalar_instruction_set<T>::template binary<tag>(x[k], y[k]);
+        return _mm256_load_si256(reinterpret_cast<const __m256i*>(x));
+    }
+
+    template<typename T2, typename tag> struct unary_op { T2 operator()(T2 a) { return lanewise<tag>(a); } };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return invert(a); } };
+
+    template<class tag>
+    static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
+
+    template<typename T2, typename tag> struct binary_op { T2 operator()(T2 a, T2 b) { return lanewise<tag>(a, b); } };
+    template<typename T2> struct binary_op<T2,add_tag> { T2 operator()(T2 a, T2 b) { return add(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,sub_tag> { T2 operator()(T2 a, T2 b) { return sub(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,mul_tag> { T2 operator()(T2 a, T2 b) { return mul(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return min(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return max(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return greater(b, a, lane_type()); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return invert(greater(a, b, lane_type())); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return greater(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return invert(greater(b, a, lane_type())); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return equal(a, b, lane_type()); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return invert(equal(a, b, lane_type())); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return _mm256_and_si256(a, b); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return _mm256_or_si256(a, b); } };
+
+    template<class tag>
+    static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return add(mul(a, b, lane_type()), c, lane_type()); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return sub(mul(a, b, lane_type()), c, lane_type()); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return sub(c, mul(a, b, lane_type()), lane_type()); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return select(a, b, c); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) {
+        ARRR_ALIGN(32) value_type x[pack_size];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(x), a);
+        value_type result = x[0];
+        for(size_t k = 1;k<pack_size;++k)
+            result = scalar_instruction_set<T>::template binary<tag>(result, x[k]);
+        return result;
+    }
+};
+
+template<typename T>
+struct instruction_set : public std::conditional<is_vector_integer<T>::value, integer_instruction_set<T>, avx::instruction_set<T>>::type { };
+
+// floating point differs from avx by fused multiply-add, which the
+// elementary functions are instantiated with as well
+#if defined(ARRR_DISPATCH) || defined(__FMA__)
+template<>
+struct instruction_set<float> : public avx::instruction_set<float> {
+    // avx2 widens and narrows bfloat16 in a single register. The dispatched
+    // avx2 code also assumes F16C for half, the avx code it inherits from
+    // does not.
+    using avx::instruction_set<float>::load;
+    using avx::instruction_set<float>::loadu;
+    using avx::instruction_set<float>::store;
+    using avx::instruction_set<float>::storeu;
+    using avx::instruction_set<float>::stream;
+    using avx::instruction_set<float>::widen;
+    using avx::instruction_set<float>::narrow;
+#if defined(ARRR_DISPATCH) && !defined(__F16C__)
+    template<typename R> static pack_type widen(const basic_half<R> *ptr) { return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr))); }
+    template<typename R> static void narrow(basic_half<R> *ptr, pack_type val) { _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), _mm256_cvtps_ph(val, R::mode)); }
+#endif
+    template<typename R> static pack_type widen(const basic_bfloat16<R> *ptr) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr))), 16)); }
+    template<typename R> static void narrow(basic_bfloat16<R> *ptr, pack_type val) {
+        const __m256i bits = _mm256_castps_si256(val), sign = _mm256_srai_epi32(bits, 31), low = _mm256_set1_epi32(0xffff);
+        __m256i bias = _mm256_setzero_si256();
+        if(R::mode == round_to_nearest::mode)
+            bias = _mm256_add_epi32(_mm256_set1_epi32(0x7fff), _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1)));
+        else if(R::mode == round_down::mode)
+            bias = _mm256_and_si256(sign, low);
+        else if(R::mode == round_up::mode)
+            bias = _mm256_andnot_si256(sign, low);
+        const __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(val, val, _CMP_UNORD_Q));
+        const __m256i rounded = _mm256_srai_epi32(_mm256_blendv_epi8(_mm256_add_epi32(bits, bias), _mm256_or_si256(bits, _mm256_set1_epi32(0x400000)), nan), 16);
+        const __m256i packed = _mm256_packs_epi32(rounded, rounded);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), _mm256_castsi256_si128(_mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+    ARRR_FLOAT16_ACCESS
+    ARRR_FLOAT16_MASKED_ACCESS
+    // gathers use the avx2 instructions, scatters stay lane by lane. The
+    // masked variants only read the indices of the valid lanes.
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return _mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices+index)), 4); }
+    static pack_type gather(const value_type *base, const int32_t *indices, const masked_index &index) {
+        return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, _mm256_maskload_epi32(indices+index.index, index.mask), _mm256_castsi256_ps(index.mask), 4);
+    }
+    static __m256i offsets(size_t stride) { return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int(stride))); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return _mm256_i32gather_ps(ptr+index*stride, offsets(stride), 4); }
+    static pack_type load_strided(const value_type *ptr, const masked_index &index, size_t stride) {
+        return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), ptr+index.index*stride, offsets(stride), _mm256_castsi256_ps(index.mask), 4);
+    }
+
+    template<typename T2, typename tag> struct unary_op : public avx::instruction_set<float>::unary_op<T2,tag> { };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::tanh(a); } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rcp(a, P()); } };
+
+    template<class tag>
+    static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
+
+    template<typename T2, typename tag> struct binary_op : public avx::instruction_set<float>::binary_op<T2,tag> { };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<instruction_set>::pow(a, b); } };
+
+    template<class tag>
+    static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_fmadd_ps(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_fmsub_ps(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_fnmadd_ps(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_blendv_ps(c, b, a); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+};
+
 template<>
-struct vector_instruction_set<float> {
+struct instruction_set<double> : public avx::instruction_set<double> {
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return _mm256_i32gather_pd(base, _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices+index)), 8); }
+    static pack_type gather(const value_type *base, const int32_t *indices, const masked_index &index) {
+        const __m128i mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(index.mask, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, _mm_maskload_epi32(indices+index.index, mask), _mm256_castsi256_pd(index.mask), 8);
+    }
+    static __m128i offsets(size_t stride) { return _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(int(stride))); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return _mm256_i32gather_pd(ptr+index*stride, offsets(stride), 8); }
+    static pack_type load_strided(const value_type *ptr, const masked_index &index, size_t stride) {
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), ptr+index.index*stride, offsets(stride), _mm256_castsi256_pd(index.mask), 8);
+    }
+
+    template<typename T2, typename tag> struct unary_op : public avx::instruction_set<double>::unary_op<T2,tag> { };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::tanh(a); } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rcp(a, P()); } };
+
+    template<class tag>
+    static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
+
+    template<typename T2, typename tag> struct binary_op : public avx::instruction_set<double>::binary_op<T2,tag> { };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<instruction_set>::pow(a, b); } };
+
+    template<class tag>
+    static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_fmadd_pd(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_fmsub_pd(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_fnmadd_pd(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm256_blendv_pd(c, b, a); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+};
+#endif
+}
+#if defined(ARRR_DISPATCH)
+#pragma GCC pop_options
+#endif
+#endif
+
+#if defined(ARRR_DISPATCH) || defined(__AVX512F__)
+#if defined(ARRR_DISPATCH)
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma,f16c")
+#endif
+namespace avx512 {
+
+// integer types use the avx2 instruction sets
+template<typename T>
+struct instruction_set : public avx2::instruction_set<T> { };
+
+template<>
+struct instruction_set<float> {
     typedef float value_type;
-    typedef __m128 pack_type;
-    static const size_t pack_size = 4;
-    static const size_t alignment = 16;
-    static const size_t registers = 8;
+    typedef __m512 pack_type;
+    static const size_t pack_size = 16;
+    static const size_t alignment = 64;
+    static const size_t registers = 32;
+    static const bool masked_tail = true;
 
     template<typename T2>
-    static pack_type set(T2 value) { return _mm_set1_ps(value); }
-    static pack_type load(const value_type *ptr, size_t index) { return _mm_load_ps(ptr+index); }
-    static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm_store_ps(ptr+index, val); return val; }
-    static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm_stream_ps(ptr+index, val); return val; }
+    static pack_type set(T2 value) { return _mm512_set1_ps(value); }
+    static pack_type load(const value_type *ptr, size_t index) { return _mm512_load_ps(ptr+index); }
+    static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm512_store_ps(ptr+index, val); return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return _mm512_loadu_ps(ptr+index); }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { _mm512_storeu_ps(ptr+index, val); return val; }
+    static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm512_stream_ps(ptr+index, val); return val; }
+    static void fence() { _mm_sfence(); }
+
+    // masked_index addresses the first count elements starting at index
+    struct masked_index { size_t index; __mmask16 mask; };
+    static masked_index mask(size_t index, size_t count) { masked_index result = { index, __mmask16((1u<<count)-1) }; return result; }
+    static pack_type load(const value_type *ptr, const masked_index &index) { return _mm512_maskz_load_ps(index.mask, ptr+index.index); }
+    static pack_type store(value_type *ptr, const masked_index &index, pack_type val) { _mm512_mask_store_ps(ptr+index.index, index.mask, val); return val; }
+    static pack_type loadu(const value_type *ptr, const masked_index &index) { return _mm512_maskz_loadu_ps(index.mask, ptr+index.index); }
+    static pack_type storeu(value_type *ptr, const masked_index &index, pack_type val) { _mm512_mask_storeu_ps(ptr+index.index, index.mask, val); return val; }
+    static pack_type stream(value_type *ptr, const masked_index &index, pack_type val) { _mm512_mask_store_ps(ptr+index.index, index.mask, val); return val; }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+    static pack_type blend_tail(pack_type a, pack_type fill, const masked_index &index) { return _mm512_mask_blend_ps(index.mask, fill, a); }
+
+    // scatters write the lanes in order, so the last of repeated indices
+    // wins like in the other instruction sets. Accumulating has to see
+    // the repetitions and goes lane by lane.
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), __mmask16(0xffff), _mm512_loadu_si512(indices+index), base, 4); }
+    static pack_type gather(const value_type *base, const int32_t *indices, const masked_index &index) { return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), index.mask, _mm512_maskz_loadu_epi32(index.mask, indices+index.index), base, 4); }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { _mm512_i32scatter_ps(base, _mm512_loadu_si512(indices+index), val, 4); }
+    static void scatter(value_type *base, const int32_t *indices, const masked_index &index, pack_type val) { _mm512_mask_i32scatter_ps(base, index.mask, _mm512_maskz_loadu_epi32(index.mask, indices+index.index), val, 4); }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index, pack_size, val); }
+    static size_t lanes(const masked_index &index) { return size_t(__builtin_popcount(index.mask)); }
+    static void scatter_add(value_type *base, const int32_t *indices, const masked_index &index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index.index, lanes(index), val); }
+    static __m512i offsets(size_t stride) { return _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(int(stride))); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), __mmask16(0xffff), offsets(stride), ptr+index*stride, 4); }
+    static pack_type load_strided(const value_type *ptr, const masked_index &index, size_t stride) { return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), index.mask, offsets(stride), ptr+index.index*stride, 4); }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { _mm512_i32scatter_ps(ptr+index*stride, offsets(stride), val, 4); }
+    static void store_strided(value_type *ptr, const masked_index &index, size_t stride, pack_type val) { _mm512_mask_i32scatter_ps(ptr+index.index*stride, index.mask, offsets(stride), val, 4); }
+    // transpose interleaves pairs of rows and pairs of pairs inside the 128
+    // bit lanes like avx, then transposes the 4x4 blocks of lanes
+    static void transpose(pack_type *rows) {
+        pack_type t[16], u[16];
+        for(int k = 0;k<16;k += 2) {
+            t[k] = _mm512_unpacklo_ps(rows[k], rows[k+1]);
+            t[k+1] = _mm512_unpackhi_ps(rows[k], rows[k+1]);
+        }
+        for(int k = 0;k<16;k += 4) {
+            u[k] = _mm512_shuffle_ps(t[k], t[k+2], _MM_SHUFFLE(1, 0, 1, 0));
+            u[k+1] = _mm512_shuffle_ps(t[k], t[k+2], _MM_SHUFFLE(3, 2, 3, 2));
+            u[k+2] = _mm512_shuffle_ps(t[k+1], t[k+3], _MM_SHUFFLE(1, 0, 1, 0));
+            u[k+3] = _mm512_shuffle_ps(t[k+1], t[k+3], _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        for(int k = 0;k<4;++k) {
+            const pack_type e0 = _mm512_shuffle_f32x4(u[k], u[k+4], 0x88), o0 = _mm512_shuffle_f32x4(u[k], u[k+4], 0xdd);
+            const pack_type e1 = _mm512_shuffle_f32x4(u[k+8], u[k+12], 0x88), o1 = _mm512_shuffle_f32x4(u[k+8], u[k+12], 0xdd);
+            rows[k] = _mm512_shuffle_f32x4(e0, e1, 0x88);
+            rows[k+4] = _mm512_shuffle_f32x4(o0, o1, 0x88);
+            rows[k+8] = _mm512_shuffle_f32x4(e0, e1, 0xdd);
+            rows[k+12] = _mm512_shuffle_f32x4(o0, o1, 0xdd);
+        }
+    }
+    // even, odd and the interleaves pick their elements from both packs
+    // with a single two source permutation
+    static pack_type even(pack_type a, pack_type b) { return _mm512_permutex2var_ps(a, _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30), b); }
+    static pack_type odd(pack_type a, pack_type b) { return _mm512_permutex2var_ps(a, _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31), b); }
+    static pack_type interleave_low(pack_type a, pack_type b) { return _mm512_permutex2var_ps(a, _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23), b); }
+    static pack_type interleave_high(pack_type a, pack_type b) { return _mm512_permutex2var_ps(a, _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31), b); }
+    static pack_type convert(__m512d lo, __m512d hi) { return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_castps_pd(_mm512_cvtpd_ps(lo))), _mm256_castps_pd(_mm512_cvtpd_ps(hi)), 1)); }
+    // avx-512 converts half itself, bfloat16 is shifted between the halves
+    // of the lanes
+    template<typename R> static pack_type widen(const basic_half<R> *ptr) { return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr))); }
+    template<typename R> static void narrow(basic_half<R> *ptr, pack_type val) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), _mm512_cvtps_ph(val, R::mode)); }
+    template<typename R> static pack_type widen(const basic_bfloat16<R> *ptr) { return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr))), 16)); }
+    template<typename R> static void narrow(basic_bfloat16<R> *ptr, pack_type val) {
+        const __m512i bits = _mm512_castps_si512(val), sign = _mm512_srai_epi32(bits, 31), low = _mm512_set1_epi32(0xffff);
+        __m512i bias = _mm512_setzero_si512();
+        if(R::mode == round_to_nearest::mode)
+            bias = _mm512_add_epi32(_mm512_set1_epi32(0x7fff), _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1)));
+        else if(R::mode == round_down::mode)
+            bias = _mm512_and_si512(sign, low);
+        else if(R::mode == round_up::mode)
+            bias = _mm512_andnot_si512(sign, low);
+        const __m512i rounded = _mm512_mask_or_epi32(_mm512_add_epi32(bits, bias), _mm512_cmp_ps_mask(val, val, _CMP_UNORD_Q), bits, _mm512_set1_epi32(0x400000));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), _mm512_cvtepi32_epi16(_mm512_srli_epi32(rounded, 16)));
+    }
+    ARRR_FLOAT16_ACCESS
+    ARRR_FLOAT16_MASKED_ACCESS
+
+    // comparisons produce mask registers, nodes pass masks around as packs
+    // with all bits of an element set or clear like the other instruction sets
+    static pack_type from_mask(__mmask16 mask) { return _mm512_castsi512_ps(_mm512_maskz_set1_epi32(mask, -1)); }
+    static __mmask16 to_mask(pack_type a) { return _mm512_test_epi32_mask(_mm512_castps_si512(a), _mm512_castps_si512(a)); }
+    static pack_type round(pack_type a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static pack_type pow2(pack_type n) { return _mm512_scalef_ps(_mm512_set1_ps(1), n); }
+    static pack_type exponent(pack_type a) { return _mm512_getexp_ps(a); }
+    static pack_type rsqrt_estimate(pack_type a) { return _mm512_rsqrt14_ps(a); }
+    static pack_type rcp_estimate(pack_type a) { return _mm512_rcp14_ps(a); }
 
     template<typename T2, typename tag> struct unary_op { };
-    template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return _mm_sqrt_ps(a); } };
-    template<typename T2> struct unary_op<T2,rsqrt_tag> { T2 operator()(T2 a) { return _mm_rsqrt_ps(a); } };
-    template<typename T2> struct unary_op<T2,rcp_tag> { T2 operator()(T2 a) { return _mm_rcp_ps(a); } };
+    template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return _mm512_sqrt_ps(a); } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rcp(a, P()); } };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(-1))); } };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::tanh(a); } };
 
     template<class tag>
     static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
 
     template<typename T2, typename tag> struct binary_op { };
-    template<typename T2> struct binary_op<T2,add_tag> { T2 operator()(T2 a, T2 b) { return _mm_add_ps(a, b); } };
-    template<typename T2> struct binary_op<T2,sub_tag> { T2 operator()(T2 a, T2 b) { return _mm_sub_ps(a, b); } };
-    template<typename T2> struct binary_op<T2,mul_tag> { T2 operator()(T2 a, T2 b) { return _mm_mul_ps(a, b); } };
-    template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return _mm_div_ps(a, b); } };
-    template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return _mm_min_ps(a, b); } };
-    template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return _mm_max_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,add_tag> { T2 operator()(T2 a, T2 b) { return _mm512_add_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,sub_tag> { T2 operator()(T2 a, T2 b) { return _mm512_sub_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,mul_tag> { T2 operator()(T2 a, T2 b) { return _mm512_mul_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return _mm512_div_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return _mm512_min_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return _mm512_max_ps(a, b); } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_ps_mask(a, b, _CMP_LT_OQ)); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_ps_mask(a, b, _CMP_LE_OQ)); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_ps_mask(a, b, _CMP_GT_OQ)); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_ps_mask(a, b, _CMP_GE_OQ)); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ)); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ)); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_castps_si512(b))); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(a), _mm512_castps_si512(b))); } };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<instruction_set>::pow(a, b); } };
 
     template<class tag>
     static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm512_fmadd_ps(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm512_fmsub_ps(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm512_fnmadd_ps(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm512_mask_blend_ps(to_mask(a), c, b); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) {
+        a = binary<tag>(a, _mm512_shuffle_f32x4(a, a, _MM_SHUFFLE(1,0,3,2)));
+        a = binary<tag>(a, _mm512_shuffle_f32x4(a, a, _MM_SHUFFLE(2,3,0,1)));
+        a = binary<tag>(a, _mm512_permute_ps(a, _MM_SHUFFLE(1,0,3,2)));
+        a = binary<tag>(a, _mm512_permute_ps(a, _MM_SHUFFLE(2,3,0,1)));
+        return _mm_cvtss_f32(_mm512_castps512_ps128(a));
+    }
 };
 
 template<>
-struct vector_instruction_set<double> {
+struct instruction_set<double> {
     typedef double value_type;
-    typedef __m128d pack_type;
-    static const size_t pack_size = 2;
-    static const size_t alignment = 16;
-    static const size_t registers = 8;
+    typedef __m512d pack_type;
+    static const size_t pack_size = 8;
+    static const size_t alignment = 64;
+    static const size_t registers = 32;
+    static const bool masked_tail = true;
 
     template<typename T2>
-    static pack_type set(T2 value) { return _mm_set1_pd(value); }
-    static pack_type load(const value_type *ptr, size_t index) { return _mm_load_pd(ptr+index); }
-    static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm_store_pd(ptr+index, val); return val; }
-    static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm_stream_pd(ptr+index, val); return val; }
+    static pack_type set(T2 value) { return _mm512_set1_pd(value); }
+    static pack_type load(const value_type *ptr, size_t index) { return _mm512_load_pd(ptr+index); }
+    static pack_type store(value_type *ptr, size_t index, pack_type val) { _mm512_store_pd(ptr+index, val); return val; }
+    static pack_type loadu(const value_type *ptr, size_t index) { return _mm512_loadu_pd(ptr+index); }
+    static pack_type storeu(value_type *ptr, size_t index, pack_type val) { _mm512_storeu_pd(ptr+index, val); return val; }
+    static pack_type stream(value_type *ptr, size_t index, pack_type val) { _mm512_stream_pd(ptr+index, val); return val; }
+    static void fence() { _mm_sfence(); }
+
+    // masked_index addresses the first count elements starting at index
+    struct masked_index { size_t index; __mmask8 mask; };
+    static masked_index mask(size_t index, size_t count) { masked_index result = { index, __mmask8((1u<<count)-1) }; return result; }
+    static pack_type load(const value_type *ptr, const masked_index &index) { return _mm512_maskz_load_pd(index.mask, ptr+index.index); }
+    static pack_type store(value_type *ptr, const masked_index &index, pack_type val) { _mm512_mask_store_pd(ptr+index.index, index.mask, val); return val; }
+    static pack_type loadu(const value_type *ptr, const masked_index &index) { return _mm512_maskz_loadu_pd(index.mask, ptr+index.index); }
+    static pack_type storeu(value_type *ptr, const masked_index &index, pack_type val) { _mm512_mask_storeu_pd(ptr+index.index, index.mask, val); return val; }
+    static pack_type stream(value_type *ptr, const masked_index &index, pack_type val) { _mm512_mask_store_pd(ptr+index.index, index.mask, val); return val; }
+    static pack_type blend_tail(pack_type a, pack_type, size_t) { return a; }
+    static pack_type blend_tail(pack_type a, pack_type fill, const masked_index &index) { return _mm512_mask_blend_pd(index.mask, fill, a); }
+
+    static __m256i indices8(const int32_t *indices, const masked_index &index) { return _mm512_castsi512_si256(_mm512_maskz_loadu_epi32(index.mask, indices+index.index)); }
+    static pack_type gather(const value_type *base, const int32_t *indices, size_t index) { return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), __mmask8(0xff), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices+index)), base, 8); }
+    static pack_type gather(const value_type *base, const int32_t *indices, const masked_index &index) { return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), index.mask, indices8(indices, index), base, 8); }
+    static void scatter(value_type *base, const int32_t *indices, size_t index, pack_type val) { _mm512_i32scatter_pd(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices+index)), val, 8); }
+    static void scatter(value_type *base, const int32_t *indices, const masked_index &index, pack_type val) { _mm512_mask_i32scatter_pd(base, index.mask, indices8(indices, index), val, 8); }
+    static void scatter_add(value_type *base, const int32_t *indices, size_t index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index, pack_size, val); }
+    static size_t lanes(const masked_index &index) { return size_t(__builtin_popcount(index.mask)); }
+    static void scatter_add(value_type *base, const int32_t *indices, const masked_index &index, pack_type val) { indexed_lanes<instruction_set>::scatter_add(base, indices, index.index, lanes(index), val); }
+    static __m256i offsets(size_t stride) { return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int(stride))); }
+    static pack_type load_strided(const value_type *ptr, size_t index, size_t stride) { return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), __mmask8(0xff), offsets(stride), ptr+index*stride, 8); }
+    static pack_type load_strided(const value_type *ptr, const masked_index &index, size_t stride) { return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), index.mask, offsets(stride), ptr+index.index*stride, 8); }
+    static void store_strided(value_type *ptr, size_t index, size_t stride, pack_type val) { _mm512_i32scatter_pd(ptr+index*stride, offsets(stride), val, 8); }
+    static void store_strided(value_type *ptr, const masked_index &index, size_t stride, pack_type val) { _mm512_mask_i32scatter_pd(ptr+index.index*stride, index.mask, offsets(stride), val, 8); }
+    static void transpose(pack_type *rows) {
+        pack_type t[8];
+        for(int k = 0;k<8;k += 2) {
+            t[k] = _mm512_unpacklo_pd(rows[k], rows[k+1]);
+            t[k+1] = _mm512_unpackhi_pd(rows[k], rows[k+1]);
+        }
+        for(int k = 0;k<2;++k) {
+            const pack_type e0 = _mm512_shuffle_f64x2(t[k], t[k+2], 0x88), o0 = _mm512_shuffle_f64x2(t[k], t[k+2], 0xdd);
+            const pack_type e1 = _mm512_shuffle_f64x2(t[k+4], t[k+6], 0x88), o1 = _mm512_shuffle_f64x2(t[k+4], t[k+6], 0xdd);
+            rows[k] = _mm512_shuffle_f64x2(e0, e1, 0x88);
+            rows[k+2] = _mm512_shuffle_f64x2(o0, o1, 0x88);
+            rows[k+4] = _mm512_shuffle_f64x2(e0, e1, 0xdd);
+            rows[k+6] = _mm512_shuffle_f64x2(o0, o1, 0xdd);
+        }
+    }
+    static pack_type even(pack_type a, pack_type b) { return _mm512_permutex2var_pd(a, _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14), b); }
+    static pack_type odd(pack_type a, pack_type b) { return _mm512_permutex2var_pd(a, _mm512_setr_epi64(1, 3, 5, 7, 9, 11, 13, 15), b); }
+    static pack_type interleave_low(pack_type a, pack_type b) { return _mm512_permutex2var_pd(a, _mm512_setr_epi64(0, 8, 1, 9, 2, 10, 3, 11), b); }
+    static pack_type interleave_high(pack_type a, pack_type b) { return _mm512_permutex2var_pd(a, _mm512_setr_epi64(4, 12, 5, 13, 6, 14, 7, 15), b); }
+    static pack_type convert(__m256 a) { return _mm512_cvtps_pd(a); }
+
+    // comparisons produce mask registers, nodes pass masks around as packs
+    // with all bits of an element set or clear like the other instruction sets
+    static pack_type from_mask(__mmask8 mask) { return _mm512_castsi512_pd(_mm512_maskz_set1_epi64(mask, -1)); }
+    static __mmask8 to_mask(pack_type a) { return _mm512_test_epi64_mask(_mm512_castpd_si512(a), _mm512_castpd_si512(a)); }
+    static pack_type round(pack_type a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static pack_type pow2(pack_type n) { return _mm512_scalef_pd(_mm512_set1_pd(1), n); }
+    static pack_type exponent(pack_type a) { return _mm512_getexp_pd(a); }
+    static pack_type rsqrt_estimate(pack_type a) { return _mm512_rsqrt14_pd(a); }
+    static pack_type rcp_estimate(pack_type a) { return _mm512_rcp14_pd(a); }
 
     template<typename T2, typename tag> struct unary_op { };
-    template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return _mm_sqrt_pd(a); } };
-    template<typename T2> struct unary_op<T2,rsqrt_tag> { T2 operator()(T2 a) { return _mm_rsqrt_pd(a); } };
-    template<typename T2> struct unary_op<T2,rcp_tag> { T2 operator()(T2 a) { return _mm_rcp_pd(a); } };
+    template<typename T2> struct unary_op<T2,sqrt_tag> { T2 operator()(T2 a) { return _mm512_sqrt_pd(a); } };
+    template<typename T2, typename P> struct unary_op<T2,rsqrt_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rsqrt(a, P()); } };
+    template<typename T2, typename P> struct unary_op<T2,rcp_tag<P>> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::rcp(a, P()); } };
+    template<typename T2> struct unary_op<T2,not_tag> { T2 operator()(T2 a) { return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_set1_epi32(-1))); } };
+    template<typename T2> struct unary_op<T2,exp_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::exp(a); } };
+    template<typename T2> struct unary_op<T2,log_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::log(a); } };
+    template<typename T2> struct unary_op<T2,sin_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::sin(a); } };
+    template<typename T2> struct unary_op<T2,cos_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::cos(a); } };
+    template<typename T2> struct unary_op<T2,tanh_tag> { T2 operator()(T2 a) { return elementary_functions<instruction_set>::tanh(a); } };
 
     template<class tag>
     static pack_type unary(pack_type a) { return unary_op<pack_type,tag>()(a); }
 
     template<typename T2, typename tag> struct binary_op { };
-    template<typename T2> struct binary_op<T2,add_tag> { T2 operator()(T2 a, T2 b) { return _mm_add_pd(a, b); } };
-    template<typename T2> struct binary_op<T2,sub_tag> { T2 operator()(T2 a, T2 b) { return _mm_sub_pd(a, b); } };
-    template<typename T2> struct binary_op<T2,mul_tag> { T2 operator()(T2 a, T2 b) { return _mm_mul_pd(a, b); } };
-    template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return _mm_div_pd(a, b); } };
-    template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return _mm_min_pd(a, b); } };
-    template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return _mm_max_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,add_tag> { T2 operator()(T2 a, T2 b) { return _mm512_add_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,sub_tag> { T2 operator()(T2 a, T2 b) { return _mm512_sub_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,mul_tag> { T2 operator()(T2 a, T2 b) { return _mm512_mul_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,div_tag> { T2 operator()(T2 a, T2 b) { return _mm512_div_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,min_tag> { T2 operator()(T2 a, T2 b) { return _mm512_min_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,max_tag> { T2 operator()(T2 a, T2 b) { return _mm512_max_pd(a, b); } };
+    template<typename T2> struct binary_op<T2,lt_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_pd_mask(a, b, _CMP_LT_OQ)); } };
+    template<typename T2> struct binary_op<T2,le_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_pd_mask(a, b, _CMP_LE_OQ)); } };
+    template<typename T2> struct binary_op<T2,gt_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ)); } };
+    template<typename T2> struct binary_op<T2,ge_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_pd_mask(a, b, _CMP_GE_OQ)); } };
+    template<typename T2> struct binary_op<T2,eq_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ)); } };
+    template<typename T2> struct binary_op<T2,ne_tag> { T2 operator()(T2 a, T2 b) { return from_mask(_mm512_cmp_pd_mask(a, b, _CMP_NEQ_UQ)); } };
+    template<typename T2> struct binary_op<T2,and_tag> { T2 operator()(T2 a, T2 b) { return _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a), _mm512_castpd_si512(b))); } };
+    template<typename T2> struct binary_op<T2,or_tag> { T2 operator()(T2 a, T2 b) { return _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(a), _mm512_castpd_si512(b))); } };
+    template<typename T2> struct binary_op<T2,pow_tag> { T2 operator()(T2 a, T2 b) { return elementary_functions<instruction_set>::pow(a, b); } };
 
     template<class tag>
     static pack_type binary(pack_type a, pack_type b) { return binary_op<pack_type,tag>()(a,b); }
+
+    template<typename T2, typename tag> struct ternary_op { };
+    template<typename T2> struct ternary_op<T2,fma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm512_fmadd_pd(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fms_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm512_fmsub_pd(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,fnma_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm512_fnmadd_pd(a, b, c); } };
+    template<typename T2> struct ternary_op<T2,select_tag> { T2 operator()(T2 a, T2 b, T2 c) { return _mm512_mask_blend_pd(to_mask(a), c, b); } };
+
+    template<class tag>
+    static pack_type ternary(pack_type a, pack_type b, pack_type c) { return ternary_op<pack_type,tag>()(a,b,c); }
+
+    template<class tag>
+    static value_type reduce(pack_type a) {
+        a = binary<tag>(a, _mm512_shuffle_f64x2(a, a, _MM_SHUFFLE(1,0,3,2)));
+        a = binary<tag>(a, _mm512_shuffle_f64x2(a, a, _MM_SHUFFLE(2,3,0,1)));
+        a = binary<tag>(a, _mm512_permute_pd(a, 0x55));
+        return _mm_cvtsd_f64(_mm512_castpd512_pd128(a));
+    }
 };
+}
+#if defined(ARRR_DISPATCH)
+#pragma GCC pop_options
+#endif
 #endif
+
+#if defined(ARRR_DISPATCH)
+template<typename T>
+struct dispatch_instruction_set;
+
+template<typename T>
+using vector_instruction_set = dispatch_instruction_set<T>;
+#elif defined(__AVX512F__)
+template<typename T>
+using vector_instruction_set = avx512::instruction_set<T>;
+#elif defined(__AVX2__)
+template<typename T>
+using vector_instruction_set = avx2::instruction_set<T>;
+#elif defined(__AVX__)
+template<typename T>
+using vector_instruction_set = avx::instruction_set<T>;
+#elif defined(__SSE2__)
+template<typename T>
+using vector_instruction_set = sse2::instruction_set<T>;
+#else
+template<typename T>
+using vector_instruction_set = scalar_instruction_set<T>;
+#endif
+
+#undef ARRR_FLOAT16_ACCESS
+#undef ARRR_FLOAT16_MASKED_ACCESS
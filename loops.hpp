@@ -1,18 +1,10 @@
-
-template<int unroll, typename Enable = void>
-struct loop {
-    template<typename vector_model, typename scalar_model, typename T1>
-    static void execute(T1 expr, const size_t N) {
-        size_t i = 0;
-        array_eval_t<T1,size_t,vector_model> root0;
-
-        root0.prepare(expr);
-        const size_t size1 = N&(~(1*vector_model::pack_size-1));
-        for(;i<size1;i+=vector_model::pack_size) {
-            root0.load(expr, i);
-            root0(expr, i);
-            root0.store(expr, i);
-        }
+// remainder evaluates the last N-i < vector_model::pack_size elements. If the
+// vector model supports masked loads and stores this is a single masked
+// vector iteration, otherwise a scalar loop.
+template<typename vector_model, typename scalar_model, typename Enable = void>
+struct remainder {
+    template<typename T1>
+    static void execute(T1 expr, size_t i, const size_t N) {
         array_eval_t<T1,size_t,scalar_model> root;
         root.prepare(expr);
         for(;i<N;i+=scalar_model::pack_size) {
@@ -20,6 +12,141 @@ struct loop {
             root(expr, i);
             root.store(expr, i);
         }
+        root.finish(expr);
+    }
+};
+
+template<typename vector_model, typename scalar_model>
+struct remainder<vector_model, scalar_model, typename std::enable_if<vector_model::masked_tail, void>::type> {
+    template<typename T1>
+    static void execute(T1 expr, size_t i, const size_t N) {
+        if(i == N)
+            return;
+        typedef typename vector_model::masked_index masked_index;
+        const masked_index index = vector_model::mask(i, N-i);
+        array_eval_t<T1,masked_index,vector_model> root;
+        root.prepare(expr);
+        root.load(expr, index);
+        root(expr, index);
+        root.store(expr, index);
+        root.finish(expr);
+    }
+};
+
+// roots<n> holds n evaluators of the same expression that work on
+// consecutive packs. Loading all of them before computing any keeps n
+// independent dependency chains in flight, reductions additionally get an
+// accumulator per root.
+template<int n, typename T1, typename U, typename model>
+struct roots {
+    array_eval_t<T1,U,model> head;
+    roots<n-1,T1,U,model> tail;
+
+    ARRR_INLINE void prepare(const T1 &expr) {
+        head.prepare(expr);
+        tail.prepare(expr);
+    }
+    ARRR_INLINE void finish(const T1 &expr) {
+        head.finish(expr);
+        tail.finish(expr);
+    }
+};
+
+template<typename T1, typename U, typename model>
+struct roots<0,T1,U,model> {
+    ARRR_INLINE void prepare(const T1 &) { }
+    ARRR_INLINE void finish(const T1 &) { }
+};
+
+// first_roots<k> runs one phase of the first k roots, root j on the pack
+// at i+j*pack_size.
+template<int k>
+struct first_roots {
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void load(R &root, const T1 &expr, size_t i) {
+        root.head.load(expr, i);
+        first_roots<k-1>::template load<model>(root.tail, expr, i+model::pack_size);
+    }
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void compute(R &root, const T1 &expr, size_t i) {
+        root.head(expr, i);
+        first_roots<k-1>::template compute<model>(root.tail, expr, i+model::pack_size);
+    }
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void store(R &root, const T1 &expr, size_t i) {
+        root.head.store(expr, i);
+        first_roots<k-1>::template store<model>(root.tail, expr, i+model::pack_size);
+    }
+    // one round evaluates k packs starting at i
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void round(R &root, const T1 &expr, size_t i) {
+        load<model>(root, expr, i);
+        compute<model>(root, expr, i);
+        store<model>(root, expr, i);
+    }
+};
+
+template<>
+struct first_roots<0> {
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void load(R &, const T1 &, size_t) { }
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void compute(R &, const T1 &, size_t) { }
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void store(R &, const T1 &, size_t) { }
+};
+
+// rounds<r, k> runs r rounds of the first k roots back to back
+template<int r, int k>
+struct rounds {
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void run(R &root, const T1 &expr, size_t i) {
+        first_roots<k>::template round<model>(root, expr, i);
+        rounds<r-1, k>::template run<model>(root, expr, i+k*model::pack_size);
+    }
+};
+
+template<int k>
+struct rounds<0, k> {
+    template<typename model, typename R, typename T1>
+    ARRR_INLINE static void run(R &, const T1 &, size_t) { }
+};
+
+// loop<unroll>::execute evaluates expr on the index range [begin, N) with
+// unroll roots. One iteration of the main loop runs as many rounds as fit
+// into 16 packs, the packs left over are handled by a round of all roots,
+// a round of a quarter of them and single packs. begin has to be a multiple
+// of 16*vector_model::pack_size so the unrolled bodies see the same
+// alignment as a loop starting at zero.
+template<int unroll>
+struct loop {
+    static_assert(unroll >= 1 && unroll <= 16, "unroll has to be between 1 and 16");
+    static const int per_iteration = unroll == 1 || unroll > 8 ? 1 : 16/unroll;
+    static const int quarter = unroll >= 8 ? unroll/4 : 1;
+
+    template<typename vector_model, typename scalar_model, typename T1>
+    static void execute(T1 expr, const size_t N, const size_t begin = 0) {
+        const size_t pack = vector_model::pack_size;
+        size_t i = begin;
+        roots<unroll,T1,size_t,vector_model> root;
+
+        root.prepare(expr);
+        const size_t step = per_iteration*unroll*pack;
+        for(const size_t end = i+(N-i)/step*step;i<end;i+=step)
+            rounds<per_iteration, unroll>::template run<vector_model>(root, expr, i);
+        if(per_iteration > 1) {
+            for(;i+unroll*pack<=N;i+=unroll*pack)
+                first_roots<unroll>::template round<vector_model>(root, expr, i);
+        }
+        if(quarter > 1) {
+            for(;i+quarter*pack<=N;i+=quarter*pack)
+                first_roots<quarter>::template round<vector_model>(root, expr, i);
+        }
+        for(;i+pack<=N;i+=pack)
+            first_roots<1>::template round<vector_model>(root, expr, i);
+        remainder<vector_model, scalar_model>::execute(expr, i, N);
+
+        root.finish(expr);
     }
 };
 
@@ -35,14 +162,7 @@ template<typename vector_model, typename scalar_model, int unroll, size_t N>
 struct shortloop<vector_model, scalar_model, unroll, N, typename std::enable_if<(N < vector_model::pack_size), void>::type> {
     template<typename T1>
     static void execute(T1 expr) {
-        size_t i = 0;
-        array_eval_t<T1,size_t,scalar_model> root;
-        root.prepare(expr);
-        for(;i<N;i+=scalar_model::pack_size) {
-            root.load(expr, i);
-            root(expr, i);
-            root.store(expr, i);
-        }
+        remainder<vector_model, scalar_model>::execute(expr, 0, N);
     }
 };
 
@@ -56,6 +176,8 @@ struct shortloop<vector_model, scalar_model, unroll, N, typename std::enable_if<
         root0.load(expr, 0);
         root0(expr, 0);
         root0.store(expr, 0);
+
+        root0.finish(expr);
     }
 };
 
@@ -69,14 +191,9 @@ struct shortloop<vector_model, scalar_model, unroll, N, typename std::enable_if<
         root0(expr, 0);
         root0.store(expr, 0);
 
-        size_t i = vector_model::pack_size;
-        array_eval_t<T1,size_t,scalar_model> root;
-        root.prepare(expr);
-        for(;i<N;i+=scalar_model::pack_size) {
-            root.load(expr, i);
-            root(expr, i);
-            root.store(expr, i);
-        }
+        remainder<vector_model, scalar_model>::execute(expr, 1*vector_model::pack_size, N);
+
+        root0.finish(expr);
     }
 };
 
@@ -94,6 +211,8 @@ struct shortloop<vector_model, scalar_model, unroll, N, typename std::enable_if<
         root0.load(expr, 1*vector_model::pack_size);
         root0(expr, 1*vector_model::pack_size);
         root0.store(expr, 1*vector_model::pack_size);
+
+        root0.finish(expr);
     }
 };
 
@@ -112,14 +231,9 @@ struct shortloop<vector_model, scalar_model, unroll, N, typename std::enable_if<
         root0(expr, 1*vector_model::pack_size);
         root0.store(expr, 1*vector_model::pack_size);
 
-        size_t i = 2*vector_model::pack_size;
-        array_eval_t<T1,size_t,scalar_model> root;
-        root.prepare(expr);
-        for(;i<N;i+=scalar_model::pack_size) {
-            root.load(expr, i);
-            root(expr, i);
-            root.store(expr, i);
-        }
+        remainder<vector_model, scalar_model>::execute(expr, 2*vector_model::pack_size, N);
+
+        root0.finish(expr);
     }
 };
 
@@ -141,6 +255,8 @@ struct shortloop<vector_model, scalar_model, unroll, N, typename std::enable_if<
         root0.load(expr, 2*vector_model::pack_size);
         root0(expr, 2*vector_model::pack_size);
         root0.store(expr, 2*vector_model::pack_size);
+
+        root0.finish(expr);
     }
 };
 
@@ -163,14 +279,9 @@ struct shortloop<vector_model, scalar_model, unroll, N, typename std::enable_if<
         root0(expr, 2*vector_model::pack_size);
         root0.store(expr, 2*vector_model::pack_size);
 
-        size_t i = 3*vector_model::pack_size;
-        array_eval_t<T1,size_t,scalar_model> root;
-        root.prepare(expr);
-        for(;i<N;i+=scalar_model::pack_size) {
-            root.load(expr, i);
-            root(expr, i);
-            root.store(expr, i);
-        }
+        remainder<vector_model, scalar_model>::execute(expr, 3*vector_model::pack_size, N);
+
+        root0.finish(expr);
     }
 };
 
@@ -196,309 +307,7 @@ struct shortloop<vector_model, scalar_model, unroll, N, typename std::enable_if<
         root0.load(expr, 3*vector_model::pack_size);
         root0(expr, 3*vector_model::pack_size);
         root0.store(expr, 3*vector_model::pack_size);
-    }
-};
-
-template<int unroll>
-struct loop<unroll, typename std::enable_if<(unroll>=2 && unroll<4), void>::type> {
-    template<typename vector_model, typename scalar_model, typename T1>
-    static void execute(T1 expr, const size_t N) {
-        size_t i = 0;
-        array_eval_t<T1,size_t,vector_model> root0;
-        array_eval_t<T1,size_t,vector_model> root1;
-
-        root0.prepare(expr);
-        root1.prepare(expr);
-
-        const size_t size8 = N&(~(8*vector_model::pack_size-1));
-        for(;i<size8;i+=8*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root1.load(expr, i+1*vector_model::pack_size);
-
-            root0(expr, i+0*vector_model::pack_size);
-            root1(expr, i+1*vector_model::pack_size);
-
-            root0.store(expr, i+0*vector_model::pack_size);
-            root1.store(expr, i+1*vector_model::pack_size);
-
-            root0.load(expr, i+2*vector_model::pack_size);
-            root1.load(expr, i+3*vector_model::pack_size);
-
-            root0(expr, i+2*vector_model::pack_size);
-            root1(expr, i+3*vector_model::pack_size);
-
-            root0.store(expr, i+2*vector_model::pack_size);
-            root1.store(expr, i+3*vector_model::pack_size);
-
-            root0.load(expr, i+4*vector_model::pack_size);
-            root1.load(expr, i+5*vector_model::pack_size);
-
-            root0(expr, i+4*vector_model::pack_size);
-            root1(expr, i+5*vector_model::pack_size);
-
-            root0.store(expr, i+4*vector_model::pack_size);
-            root1.store(expr, i+5*vector_model::pack_size);
-
-            root0.load(expr, i+6*vector_model::pack_size);
-            root1.load(expr, i+7*vector_model::pack_size);
-
-            root0(expr, i+6*vector_model::pack_size);
-            root1(expr, i+7*vector_model::pack_size);
-
-            root0.store(expr, i+6*vector_model::pack_size);
-            root1.store(expr, i+7*vector_model::pack_size);
-        }
-        const size_t size2 = N&(~(2*vector_model::pack_size-1));
-        for(;i<size2;i+=2*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root1.load(expr, i+1*vector_model::pack_size);
-
-            root0(expr, i+0*vector_model::pack_size);
-            root1(expr, i+1*vector_model::pack_size);
-
-            root0.store(expr, i+0*vector_model::pack_size);
-            root1.store(expr, i+1*vector_model::pack_size);
-        }
-        const size_t size1 = N&(~(1*vector_model::pack_size-1));
-        for(;i<size1;i+=1*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root0(expr, i+0*vector_model::pack_size);
-            root0.store(expr, i+0*vector_model::pack_size);
-        }
-        array_eval_t<T1,size_t,scalar_model> root;
-        root.prepare(expr);
-        for(;i<N;i+=scalar_model::pack_size) {
-            root.load(expr, i);
-            root(expr, i);
-            root.store(expr, i);
-        }
-    }
-};
-
-template<int unroll>
-struct loop<unroll, typename std::enable_if<(unroll>=4 && unroll<8), void>::type> {
-    template<typename vector_model, typename scalar_model, typename T1>
-    static void execute(T1 expr, const size_t N) {
-        size_t i = 0;
-        array_eval_t<T1,size_t,vector_model> root0;
-        array_eval_t<T1,size_t,vector_model> root1;
-        array_eval_t<T1,size_t,vector_model> root2;
-        array_eval_t<T1,size_t,vector_model> root3;
-
-        root0.prepare(expr);
-        root1.prepare(expr);
-        root2.prepare(expr);
-        root3.prepare(expr);
-
-        const size_t size16 = N&(~(16*vector_model::pack_size-1));
-        for(;i<size16;i+=16*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root1.load(expr, i+1*vector_model::pack_size);
-            root2.load(expr, i+2*vector_model::pack_size);
-            root3.load(expr, i+3*vector_model::pack_size);
-
-            root0(expr, i+0*vector_model::pack_size);
-            root1(expr, i+1*vector_model::pack_size);
-            root2(expr, i+2*vector_model::pack_size);
-            root3(expr, i+3*vector_model::pack_size);
-
-            root0.store(expr, i+0*vector_model::pack_size);
-            root1.store(expr, i+1*vector_model::pack_size);
-            root2.store(expr, i+2*vector_model::pack_size);
-            root3.store(expr, i+3*vector_model::pack_size);
-
-            root0.load(expr, i+4*vector_model::pack_size);
-            root1.load(expr, i+5*vector_model::pack_size);
-            root2.load(expr, i+6*vector_model::pack_size);
-            root3.load(expr, i+7*vector_model::pack_size);
-
-            root0(expr, i+4*vector_model::pack_size);
-            root1(expr, i+5*vector_model::pack_size);
-            root2(expr, i+6*vector_model::pack_size);
-            root3(expr, i+7*vector_model::pack_size);
-
-            root0.store(expr, i+4*vector_model::pack_size);
-            root1.store(expr, i+5*vector_model::pack_size);
-            root2.store(expr, i+6*vector_model::pack_size);
-            root3.store(expr, i+7*vector_model::pack_size);
-
-            root0.load(expr, i+8*vector_model::pack_size);
-            root1.load(expr, i+9*vector_model::pack_size);
-            root2.load(expr, i+10*vector_model::pack_size);
-            root3.load(expr, i+11*vector_model::pack_size);
-
-            root0(expr, i+8*vector_model::pack_size);
-            root1(expr, i+9*vector_model::pack_size);
-            root2(expr, i+10*vector_model::pack_size);
-            root3(expr, i+11*vector_model::pack_size);
-
-            root0.store(expr, i+8*vector_model::pack_size);
-            root1.store(expr, i+9*vector_model::pack_size);
-            root2.store(expr, i+10*vector_model::pack_size);
-            root3.store(expr, i+11*vector_model::pack_size);
-
-            root0.load(expr, i+12*vector_model::pack_size);
-            root1.load(expr, i+13*vector_model::pack_size);
-            root2.load(expr, i+14*vector_model::pack_size);
-            root3.load(expr, i+15*vector_model::pack_size);
-
-            root0(expr, i+12*vector_model::pack_size);
-            root1(expr, i+13*vector_model::pack_size);
-            root2(expr, i+14*vector_model::pack_size);
-            root3(expr, i+15*vector_model::pack_size);
-
-            root0.store(expr, i+12*vector_model::pack_size);
-            root1.store(expr, i+13*vector_model::pack_size);
-            root2.store(expr, i+14*vector_model::pack_size);
-            root3.store(expr, i+15*vector_model::pack_size);
-        }
-        const size_t size4 = N&(~(4*vector_model::pack_size-1));
-        for(;i<size4;i+=4*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root1.load(expr, i+1*vector_model::pack_size);
-            root2.load(expr, i+2*vector_model::pack_size);
-            root3.load(expr, i+3*vector_model::pack_size);
-
-            root0(expr, i+0*vector_model::pack_size);
-            root1(expr, i+1*vector_model::pack_size);
-            root2(expr, i+2*vector_model::pack_size);
-            root3(expr, i+3*vector_model::pack_size);
-
-            root0.store(expr, i+0*vector_model::pack_size);
-            root1.store(expr, i+1*vector_model::pack_size);
-            root2.store(expr, i+2*vector_model::pack_size);
-            root3.store(expr, i+3*vector_model::pack_size);
-        }
-        const size_t size1 = N&(~(1*vector_model::pack_size-1));
-        for(;i<size1;i+=1*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root0(expr, i+0*vector_model::pack_size);
-            root0.store(expr, i+0*vector_model::pack_size);
-        }
-        array_eval_t<T1,size_t,scalar_model> root;
-        root.prepare(expr);
-        for(;i<N;i+=scalar_model::pack_size) {
-            root.load(expr, i);
-            root(expr, i);
-            root.store(expr, i);
-        }
-    }
-};
 
-template<int unroll>
-struct loop<unroll, typename std::enable_if<(unroll>=8), void>::type> {
-    template<typename vector_model, typename scalar_model, typename T1>
-    static void execute(T1 expr, const size_t N) {
-        size_t i = 0;
-        array_eval_t<T1,size_t,vector_model> root0;
-        array_eval_t<T1,size_t,vector_model> root1;
-        array_eval_t<T1,size_t,vector_model> root2;
-        array_eval_t<T1,size_t,vector_model> root3;
-        array_eval_t<T1,size_t,vector_model> root4;
-        array_eval_t<T1,size_t,vector_model> root5;
-        array_eval_t<T1,size_t,vector_model> root6;
-        array_eval_t<T1,size_t,vector_model> root7;
-
-        root0.prepare(expr);
-        root1.prepare(expr);
-        root2.prepare(expr);
-        root3.prepare(expr);
-        root4.prepare(expr);
-        root5.prepare(expr);
-        root6.prepare(expr);
-        root7.prepare(expr);
-
-        const size_t size16 = N&(~(16*vector_model::pack_size-1));
-        for(;i<size16;i+=16*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root1.load(expr, i+1*vector_model::pack_size);
-            root2.load(expr, i+2*vector_model::pack_size);
-            root3.load(expr, i+3*vector_model::pack_size);
-
-            root4.load(expr, i+4*vector_model::pack_size);
-            root5.load(expr, i+5*vector_model::pack_size);
-            root6.load(expr, i+6*vector_model::pack_size);
-            root7.load(expr, i+7*vector_model::pack_size);
-
-            root0(expr, i+0*vector_model::pack_size);
-            root1(expr, i+1*vector_model::pack_size);
-            root2(expr, i+2*vector_model::pack_size);
-            root3(expr, i+3*vector_model::pack_size);
-
-            root4(expr, i+4*vector_model::pack_size);
-            root5(expr, i+5*vector_model::pack_size);
-            root6(expr, i+6*vector_model::pack_size);
-            root7(expr, i+7*vector_model::pack_size);
-
-            root0.store(expr, i+0*vector_model::pack_size);
-            root1.store(expr, i+1*vector_model::pack_size);
-            root2.store(expr, i+2*vector_model::pack_size);
-            root3.store(expr, i+3*vector_model::pack_size);
-
-            root4.store(expr, i+4*vector_model::pack_size);
-            root5.store(expr, i+5*vector_model::pack_size);
-            root6.store(expr, i+6*vector_model::pack_size);
-            root7.store(expr, i+7*vector_model::pack_size);
-
-            root0.load(expr, i+8*vector_model::pack_size);
-            root1.load(expr, i+9*vector_model::pack_size);
-            root2.load(expr, i+10*vector_model::pack_size);
-            root3.load(expr, i+11*vector_model::pack_size);
-
-            root4.load(expr, i+12*vector_model::pack_size);
-            root5.load(expr, i+13*vector_model::pack_size);
-            root6.load(expr, i+14*vector_model::pack_size);
-            root7.load(expr, i+15*vector_model::pack_size);
-
-            root0(expr, i+8*vector_model::pack_size);
-            root1(expr, i+9*vector_model::pack_size);
-            root2(expr, i+10*vector_model::pack_size);
-            root3(expr, i+11*vector_model::pack_size);
-
-            root4(expr, i+12*vector_model::pack_size);
-            root5(expr, i+13*vector_model::pack_size);
-            root6(expr, i+14*vector_model::pack_size);
-            root7(expr, i+15*vector_model::pack_size);
-
-            root0.store(expr, i+8*vector_model::pack_size);
-            root1.store(expr, i+9*vector_model::pack_size);
-            root2.store(expr, i+10*vector_model::pack_size);
-            root3.store(expr, i+11*vector_model::pack_size);
-
-            root4.store(expr, i+12*vector_model::pack_size);
-            root5.store(expr, i+13*vector_model::pack_size);
-            root6.store(expr, i+14*vector_model::pack_size);
-            root7.store(expr, i+15*vector_model::pack_size);
-        }
-        const size_t size4 = N&(~(4*vector_model::pack_size-1));
-        for(;i<size4;i+=4*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root1.load(expr, i+1*vector_model::pack_size);
-            root2.load(expr, i+2*vector_model::pack_size);
-            root3.load(expr, i+3*vector_model::pack_size);
-
-            root0(expr, i+0*vector_model::pack_size);
-            root1(expr, i+1*vector_model::pack_size);
-            root2(expr, i+2*vector_model::pack_size);
-            root3(expr, i+3*vector_model::pack_size);
-
-            root0.store(expr, i+0*vector_model::pack_size);
-            root1.store(expr, i+1*vector_model::pack_size);
-            root2.store(expr, i+2*vector_model::pack_size);
-            root3.store(expr, i+3*vector_model::pack_size);
-        }
-        const size_t size1 = N&(~(1*vector_model::pack_size-1));
-        for(;i<size1;i+=1*vector_model::pack_size) {
-            root0.load(expr, i+0*vector_model::pack_size);
-            root0(expr, i+0*vector_model::pack_size);
-            root0.store(expr, i+0*vector_model::pack_size);
-        }
-        array_eval_t<T1,size_t,scalar_model> root;
-        root.prepare(expr);
-        for(;i<N;i+=scalar_model::pack_size) {
-            root.load(expr, i);
-            root(expr, i);
-            root.store(expr, i);
-        }
+        root0.finish(expr);
     }
 };
@@ -0,0 +1,261 @@
+
+// mapped_window_bytes is the number of bytes of the widest element type a
+// windowed statement evaluates per window. It defaults to 64MiB, large
+// enough that the readahead of the next window overlaps with the compute
+// of the current one.
+inline size_t& mapped_window_bytes() {
+    static size_t bytes = size_t(64)<<20;
+    return bytes;
+}
+
+template<typename T>
+class mapped_array;
+
+// mapped_advice<T>::apply passes advice for [begin, end) to every
+// mapped_array in the expression T
+template<typename T, typename Enable = void>
+struct mapped_advice {
+    static void apply(const typename std::remove_reference<T>::type &, size_t, size_t, int) { }
+};
+
+template<typename T>
+struct mapped_advice<mapped_array<T>> {
+    static void apply(const mapped_array<T> &node, size_t begin, size_t end, int advice) { node.advise(begin, end, advice); }
+};
+
+template<typename T>
+struct mapped_advice<const mapped_array<T>&> : mapped_advice<mapped_array<T>> { };
+
+template<size_t I, typename T, typename Enable = void>
+struct mapped_advice_from {
+    static void apply(const T &, size_t, size_t, int) { }
+};
+
+template<size_t I, typename... Cs>
+struct mapped_advice_from<I, std::tuple<Cs...>, typename std::enable_if<(I < sizeof...(Cs))>::type> {
+    static void apply(const std::tuple<Cs...> &node, size_t begin, size_t end, int advice) {
+        mapped_advice<typename std::tuple_element<I, std::tuple<Cs...>>::type>::apply(std::get<I>(node), begin, end, advice);
+        mapped_advice_from<I+1, std::tuple<Cs...>>::apply(node, begin, end, advice);
+    }
+};
+
+template<typename... Cs>
+struct mapped_advice<std::tuple<Cs...>> : mapped_advice_from<0, std::tuple<Cs...>> { };
+
+inline void mapped_advise(size_t, size_t, int) { }
+
+template<typename T, typename... Ts>
+void mapped_advise(size_t begin, size_t end, int advice, const T &node, const Ts&... nodes) {
+    mapped_advice<T>::apply(node, begin, end, advice);
+    mapped_advise(begin, end, advice, nodes...);
+}
+
+// windowed_execute evaluates expr on [0, N) in windows of
+// mapped_window_bytes(). Before a window is computed the mapped arrays of
+// expr and the arrays in targets (the mapped destinations, which expr only
+// knows as pointers) are advised MADV_WILLNEED for the next window, so the
+// kernel reads ahead while this one is computed, and afterwards
+// MADV_DONTNEED for the finished one, so the mapping does not grow past
+// two windows. Window boundaries are multiples of the widest unrolled step.
+template<typename vector_model, typename scalar_model, typename T1, typename... As>
+typename std::enable_if<is_node<T1>::value, void>::type windowed_execute(T1 expr, size_t N, const As&... targets) {
+    const size_t granularity = 16*vector_model::pack_size;
+    const size_t window = std::max(granularity, mapped_window_bytes()/sizeof(typename vector_model::value_type)/granularity*granularity);
+    mapped_advise(0, std::min(N, window), MADV_WILLNEED, expr, targets...);
+    for(size_t begin = 0;begin<N;begin += window) {
+        const size_t end = std::min(N, begin+window);
+        mapped_advise(end, std::min(N, end+window), MADV_WILLNEED, expr, targets...);
+        executor<vector_model, scalar_model>::run(expr, end, begin);
+        mapped_advise(begin, end, MADV_DONTNEED, expr, targets...);
+    }
+}
+
+// windowed_policy runs statements through windowed_execute, as in
+// sum<windowed_policy>(m) or windowed(y) = 2.0f*m for a mapped m
+struct windowed_policy {
+    template<typename vector_model, typename scalar_model, typename T1>
+    static void execute(T1 expr, size_t N) { windowed_execute<vector_model, scalar_model>(expr, N); }
+};
+
+template<typename A>
+policy_reference<windowed_policy, A> windowed(A &array) {
+    return policy_reference<windowed_policy, A>(array);
+}
+
+// mapped_array is an array backed by a memory mapping of a file of
+// elements in native byte order, for data sets larger than the memory.
+// mapped_array<const T> maps the file read-only, mapped_array<T> maps it
+// shared and writable so assignments reach the file. The mapping starts at
+// a page boundary and takes part in expressions like an arithmetic_array.
+// Assignments to it run windowed (see windowed_execute). is_open() is false
+// if the file could not be opened or mapped, empty files included.
+template<typename T>
+class mapped_array {
+public:
+    typedef typename std::remove_const<T>::type value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef vector_instruction_set<typename compute_type<value_type>::type> vector_model;
+    typedef scalar_instruction_set<typename compute_type<value_type>::type> scalar_model;
+
+    // maps the whole file
+    explicit mapped_array(const char *path) : size_(0), data_(nullptr) {
+        map(path, false, 0);
+    }
+    // creates the file or resizes it to size elements and maps it
+    mapped_array(const char *path, size_type size) : size_(0), data_(nullptr) {
+        static_assert(!std::is_const<T>::value, "read-only mappings can not be resized");
+        map(path, true, size);
+    }
+    ~mapped_array() {
+        if(data_)
+            munmap(const_cast<value_type*>(data_), size_*sizeof(T));
+    }
+
+    bool is_open() const { return data_ != nullptr; }
+    size_type size() const { return size_; }
+    pointer data() const { return data_; }
+    reference operator[](size_type i) const { return data_[i]; }
+    array_view<T> slice(size_type begin, size_type end) const { return array_view<T>(data_+begin, end-begin); }
+    strided_view<T> slice(size_type begin, size_type end, size_type step) const { return strided_view<T>(data_+begin, (end-begin+step-1)/step, step); }
+    iterator begin() const { return data_; }
+    iterator end() const { return data_+size_; }
+
+    // advise passes madvise advice for the pages of the elements
+    // [begin, end). Pages are only dropped (MADV_DONTNEED) if all of their
+    // elements are in the range, other advice covers partial pages too.
+    void advise(size_type begin, size_type end, int advice) const {
+        static const uintptr_t page = uintptr_t(sysconf(_SC_PAGESIZE));
+        if(begin >= end)
+            return;
+        const uintptr_t first = reinterpret_cast<uintptr_t>(data_+begin), last = reinterpret_cast<uintptr_t>(data_+end);
+        const uintptr_t from = first/page*page;
+        const uintptr_t to = advice == MADV_DONTNEED && end < size_ ? last/page*page : (last+page-1)/page*page;
+        if(from < to)
+            madvise(reinterpret_cast<void*>(from), to-from, advice);
+    }
+
+    mapped_array& operator=(const mapped_array &rhs) {
+        windowed_update(rhs);
+        return *this;
+    }
+    template<typename T1>
+    mapped_array& operator=(const T1 &rhs) {
+        windowed_update(rhs);
+        return *this;
+    }
+    template<typename T1>
+    mapped_array& operator+=(const T1 &rhs) {
+        windowed_update(*this + rhs);
+        return *this;
+    }
+    template<typename T1>
+    mapped_array& operator-=(const T1 &rhs) {
+        windowed_update(*this - rhs);
+        return *this;
+    }
+    template<typename T1>
+    mapped_array& operator*=(const T1 &rhs) {
+        windowed_update(*this * rhs);
+        return *this;
+    }
+    template<typename T1>
+    mapped_array& operator/=(const T1 &rhs) {
+        windowed_update(*this / rhs);
+        return *this;
+    }
+
+    // assign and update evaluate rhs into the array through an execution
+    // policy
+    template<typename policy, typename T1>
+    void assign(const T1 &rhs) {
+        policy::template execute<vector_model, scalar_model>(store(data_, rhs), size_);
+    }
+    template<typename policy, typename T1>
+    void update(const T1 &rhs) {
+        policy::template execute<vector_model, scalar_model>(store(data_, rhs), size_);
+    }
+private:
+    mapped_array(const mapped_array&) = delete;
+
+    template<typename T1>
+    void windowed_update(const T1 &rhs) {
+        windowed_execute<vector_model, scalar_model>(store(data_, rhs), size_, *this);
+    }
+
+    void map(const char *path, bool resize, size_type size) {
+        const bool writable = !std::is_const<T>::value;
+        const int fd = ::open(path, writable ? O_RDWR | (resize ? O_CREAT : 0) : O_RDONLY, 0644);
+        if(fd < 0)
+            return;
+        struct stat info;
+        if(resize ? ftruncate(fd, off_t(size*sizeof(T))) == 0 : fstat(fd, &info) == 0) {
+            const size_type elements = resize ? size : size_type(info.st_size)/sizeof(T);
+            void *address = elements > 0 ? mmap(nullptr, elements*sizeof(T), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+            if(address != MAP_FAILED) {
+                madvise(address, elements*sizeof(T), MADV_SEQUENTIAL);
+                size_ = elements;
+                data_ = static_cast<pointer>(address);
+            }
+        }
+        ::close(fd);
+    }
+
+    size_type size_;
+    pointer data_;
+};
+
+template<typename T>
+struct is_node<mapped_array<T>> {
+    static const bool value = true;
+};
+
+template<typename T>
+struct rebase<const mapped_array<T>&> {
+    typedef array_view<const typename mapped_array<T>::value_type> type;
+    static type apply(const mapped_array<T> &node, size_t offset) { return type(node.data()+offset, node.size()-std::min(offset, node.size())); }
+};
+
+template<typename T>
+struct count<const mapped_array<T>&> {
+    static const int loads = 1;
+    static const int stores = 0;
+    static const int operations = 0;
+    static const int immediates = 0;
+};
+
+template<typename T>
+struct register_need<const mapped_array<T>&> {
+    static const int value = 1;
+};
+
+template<typename T>
+struct is_source<const mapped_array<T>&> {
+    static const bool value = true;
+};
+
+template<typename T>
+struct expression_traits<const mapped_array<T>&> {
+    typedef typename compute_type<typename mapped_array<T>::value_type>::type value_type;
+    static size_t size(const mapped_array<T> &node) { return node.size(); }
+};
+
+template<typename T1, typename U, typename model>
+struct array_eval_t<const mapped_array<T1>&,U,model> {
+    typedef typename model::pack_type return_type;
+    return_type tmp;
+    const typename mapped_array<T1>::value_type *ptr;
+    void prepare(const mapped_array<T1> &node) { ptr = node.data(); }
+    void load(const mapped_array<T1>&, const U &userdata) { tmp = model::load(ptr, userdata); }
+    void store(const mapped_array<T1> &, const U &) { }
+    void finish(const mapped_array<T1> &) { }
+    return_type operator()(const mapped_array<T1> &, const U &) {
+        return tmp;
+    }
+};
@@ -0,0 +1,274 @@
+// elementary_functions<model> implements exp, log, sin, cos, tanh, pow and
+// the precision policies of rsqrt and rcp once for every instruction set
+// with float or double elements. It only uses the arithmetic, compare and
+// select operations of the model plus primitives every floating point
+// instruction set provides:
+//   round(x)          x rounded to the nearest integer, ties to even
+//   pow2(n)           2^n for integral n in the normal exponent range
+//   exponent(x)       floor(log2(x)) for positive normal x
+//   rsqrt_estimate(x) hardware estimates of 1/sqrt(x) and 1/x
+//   rcp_estimate(x)
+// The scalar instruction set uses the same code so remainders agree with
+// the vector body. Other element types fall back to the std:: functions.
+//
+// Maximum errors measured against libm (float against double, double
+// against long double), the smaller figure with fma:
+//            float             double
+//   exp      1.2 (0.9) ulp     1.1 (0.9) ulp
+//   log      0.9 ulp           0.9 ulp
+//   sin/cos  1.6 ulp           1.6 ulp     for |x| < 100
+//            2.3 ulp           1.6 ulp     for |x| < 8192 (float), 2^30
+//                                          (double), undefined beyond
+//   tanh     1.4 ulp           1.4 ulp
+//   pow      grows with |y*log(x)|, about 1 + 1.5*|y*log(x)| ulp
+// pow is exp(y*log(x)) and therefore NaN for negative x, except that
+// pow(x, 0) and pow(1, y) are 1.
+//
+// Relative errors of rsqrt and rcp by precision policy, the estimates of
+// sse and avx (avx-512) have 11.6 (14) correct bits. Double estimates
+// outside of the float range saturate on sse2 and avx.
+//                   float                 double
+//   fast            2^-11.6 (2^-14)       2^-11.6 (2^-14)
+//   refined<1>      2^-22 (2^-22.9)       2^-22.7 (2^-27.5)
+//   refined<2>      2^-22.8 (2^-23)       2^-44.7 (2^-51.9)
+//   exact           correctly rounded sqrt and division
+template<typename T>
+struct math_coefficients;
+
+template<>
+struct math_coefficients<float> {
+    static constexpr float log2e = 1.44269504088896341f;
+    static constexpr float ln2_hi = 6.93145751953125e-1f;
+    static constexpr float ln2_lo = 1.42860682030941723212e-6f;
+    static constexpr float exp_max = 88.7228391f;
+    static constexpr float exp_min = -103.972076f;
+    static constexpr float two_over_pi = 6.36619772367581343076e-1f;
+    static constexpr float log_ln2_hi = 6.9313812256e-01f;
+    static constexpr float log_ln2_lo = 9.0580006145e-06f;
+    static constexpr float denormal_scale = 16777216.0f;
+    static constexpr float denormal_bits = 24.0f;
+
+    template<typename F>
+    static typename F::pack_type exp(typename F::pack_type r) {
+        return F::polynomial(r, 1.0f, 1.0f, 1.0f/2, 1.0f/6, 1.0f/24, 1.0f/120, 1.0f/720, 1.0f/5040);
+    }
+    template<typename F>
+    static typename F::pack_type log(typename F::pack_type z) {
+        return F::polynomial(z, 6.6666662693e-01f, 4.0000972152e-01f, 2.8498786688e-01f, 2.4279078841e-01f);
+    }
+    // x - j*pi/2 with pi/2 split into parts of 11 bits, j*part is exact for
+    // |j| < 2^13 even without fma
+    template<typename F>
+    static typename F::pack_type reduce(typename F::pack_type x, typename F::pack_type j) {
+        x = F::fnma(j, F::set(1.5703125f), x);
+        x = F::fnma(j, F::set(4.8375129699707031e-4f), x);
+        x = F::fnma(j, F::set(7.5495336204767227e-8f), x);
+        return F::fnma(j, F::set(2.5633440682570896e-12f), x);
+    }
+    template<typename F>
+    static typename F::pack_type sin(typename F::pack_type z) {
+        return F::polynomial(z, -1.6666654611e-1f, 8.3321608736e-3f, -1.9515295891e-4f);
+    }
+    template<typename F>
+    static typename F::pack_type cos(typename F::pack_type z) {
+        return F::polynomial(z, 4.166664568298827e-2f, -1.388731625493765e-3f, 2.443315711809948e-5f);
+    }
+    template<typename F>
+    static typename F::pack_type tanh(typename F::pack_type z) {
+        return F::polynomial(z, -3.33332819422e-1f, 1.33314422036e-1f, -5.37397155531e-2f, 2.06390887954e-2f, -5.70498872745e-3f);
+    }
+};
+
+template<>
+struct math_coefficients<double> {
+    static constexpr double log2e = 1.44269504088896341;
+    static constexpr double ln2_hi = 6.93145751953125e-1;
+    static constexpr double ln2_lo = 1.42860682030941723212e-6;
+    static constexpr double exp_max = 709.782712893383973;
+    static constexpr double exp_min = -745.133219101941108;
+    static constexpr double two_over_pi = 6.36619772367581343076e-1;
+    static constexpr double log_ln2_hi = 6.93147180369123816490e-01;
+    static constexpr double log_ln2_lo = 1.90821492927058770002e-10;
+    static constexpr double denormal_scale = 18014398509481984.0;
+    static constexpr double denormal_bits = 54.0;
+
+    template<typename F>
+    static typename F::pack_type exp(typename F::pack_type r) {
+        return F::polynomial(r, 1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320,
+            1.0/362880, 1.0/3628800, 1.0/39916800, 1.0/479001600, 1.0/6227020800);
+    }
+    template<typename F>
+    static typename F::pack_type log(typename F::pack_type z) {
+        return F::polynomial(z, 6.666666666666735130e-01, 3.999999999940941908e-01, 2.857142874366239149e-01,
+            2.222219843214978396e-01, 1.818357216161805012e-01, 1.531383769920937332e-01, 1.479819860511658591e-01);
+    }
+    template<typename F>
+    static typename F::pack_type reduce(typename F::pack_type x, typename F::pack_type j) {
+        x = F::fnma(j, F::set(1.57079625129699707031e0), x);
+        x = F::fnma(j, F::set(7.54978941586159635335e-8), x);
+        return F::fnma(j, F::set(5.39030285815811905290e-15), x);
+    }
+    template<typename F>
+    static typename F::pack_type sin(typename F::pack_type z) {
+        return F::polynomial(z, -1.66666666666666307295e-1, 8.33333333332211858878e-3, -1.98412698295895385996e-4,
+            2.75573136213857245213e-6, -2.50507477628578072866e-8, 1.58962301576546568060e-10);
+    }
+    template<typename F>
+    static typename F::pack_type cos(typename F::pack_type z) {
+        return F::polynomial(z, 4.16666666666665929218e-2, -1.38888888888730564116e-3, 2.48015872888517045348e-5,
+            -2.75573141792967388112e-7, 2.08757008419747316778e-9, -1.13585365213876817300e-11);
+    }
+    template<typename F>
+    static typename F::pack_type tanh(typename F::pack_type z) {
+        return F::div(
+            F::polynomial(z, -1.61468768441708447952e3, -9.92877231001918586564e1, -9.64399179425052238628e-1),
+            F::polynomial(z, 4.84406305325125486048e3, 2.23548839060100448583e3, 1.12811678491632931402e2, 1.0)
+        );
+    }
+};
+
+template<typename model, typename Enable = void>
+struct elementary_functions {
+    typedef typename model::pack_type pack_type;
+
+    static pack_type exp(pack_type a) { return std::exp(a); }
+    static pack_type log(pack_type a) { return std::log(a); }
+    static pack_type sin(pack_type a) { return std::sin(a); }
+    static pack_type cos(pack_type a) { return std::cos(a); }
+    static pack_type tanh(pack_type a) { return std::tanh(a); }
+    static pack_type pow(pack_type a, pack_type b) { return std::pow(a, b); }
+
+    template<typename precision>
+    static pack_type rsqrt(pack_type a, precision) { return pack_type(1)/std::sqrt(a); }
+    template<typename precision>
+    static pack_type rcp(pack_type a, precision) { return pack_type(1)/a; }
+};
+
+template<typename model>
+struct elementary_functions<model, typename std::enable_if<
+    std::is_same<typename model::value_type, float>::value || std::is_same<typename model::value_type, double>::value
+>::type> {
+    typedef typename model::value_type value_type;
+    typedef typename model::pack_type pack_type;
+    typedef math_coefficients<value_type> coefficients;
+    typedef typename std::conditional<sizeof(value_type) == 4, uint32_t, uint64_t>::type bits_type;
+
+    static pack_type set(value_type a) { return model::set(a); }
+    static pack_type set_bits(bits_type a) { value_type value; std::memcpy(&value, &a, sizeof(value)); return model::set(value); }
+    static pack_type add(pack_type a, pack_type b) { return model::template binary<add_tag>(a, b); }
+    static pack_type sub(pack_type a, pack_type b) { return model::template binary<sub_tag>(a, b); }
+    static pack_type mul(pack_type a, pack_type b) { return model::template binary<mul_tag>(a, b); }
+    static pack_type div(pack_type a, pack_type b) { return model::template binary<div_tag>(a, b); }
+    static pack_type fma(pack_type a, pack_type b, pack_type c) { return model::template ternary<fma_tag>(a, b, c); }
+    static pack_type fnma(pack_type a, pack_type b, pack_type c) { return model::template ternary<fnma_tag>(a, b, c); }
+    static pack_type bit_and(pack_type a, pack_type b) { return model::template binary<and_tag>(a, b); }
+    static pack_type bit_or(pack_type a, pack_type b) { return model::template binary<or_tag>(a, b); }
+    static pack_type less(pack_type a, pack_type b) { return model::template binary<lt_tag>(a, b); }
+    static pack_type equal(pack_type a, pack_type b) { return model::template binary<eq_tag>(a, b); }
+    static pack_type select(pack_type mask, pack_type a, pack_type b) { return model::template ternary<select_tag>(mask, a, b); }
+
+    // polynomial(x, c0, c1, ...) = c0 + x*(c1 + x*(...))
+    static pack_type polynomial(pack_type, value_type c) { return set(c); }
+    template<typename... Ts>
+    static pack_type polynomial(pack_type x, value_type c, Ts... rest) { return fma(polynomial(x, value_type(rest)...), x, set(c)); }
+
+    static pack_type round(pack_type x) { return model::round(x); }
+    static pack_type floor(pack_type x) {
+        const pack_type r = round(x);
+        return sub(r, select(less(x, r), set(1), set(0)));
+    }
+
+    static pack_type exp(pack_type x) {
+        const pack_type n = round(mul(x, set(coefficients::log2e)));
+        pack_type r = fnma(n, set(coefficients::ln2_hi), x);
+        r = fnma(n, set(coefficients::ln2_lo), r);
+        // 2^n is applied in two halves so results near and below the
+        // smallest normal number still come out right
+        const pack_type n1 = round(mul(n, set(0.5)));
+        pack_type result = mul(mul(coefficients::template exp<elementary_functions>(r), model::pow2(n1)), model::pow2(sub(n, n1)));
+        result = select(less(set(coefficients::exp_max), x), set(std::numeric_limits<value_type>::infinity()), result);
+        return select(less(x, set(coefficients::exp_min)), set(0), result);
+    }
+
+    static pack_type log(pack_type x) {
+        const int mantissa_bits = std::numeric_limits<value_type>::digits-1;
+        const pack_type denormal = less(x, set(std::numeric_limits<value_type>::min()));
+        pack_type m = select(denormal, mul(x, set(coefficients::denormal_scale)), x);
+        pack_type e = sub(model::exponent(m), select(denormal, set(coefficients::denormal_bits), set(0)));
+        // m in [sqrt(1/2), sqrt(2)), log(x) = e*ln2 + log(m)
+        m = bit_or(bit_and(m, set_bits((bits_type(1) << mantissa_bits)-1)), set(1));
+        const pack_type big = less(set(value_type(1.41421356237309504880)), m);
+        m = select(big, mul(m, set(0.5)), m);
+        e = select(big, add(e, set(1)), e);
+        const pack_type f = sub(m, set(1));
+        const pack_type s = div(f, add(f, set(2)));
+        const pack_type z = mul(s, s);
+        const pack_type R = mul(z, coefficients::template log<elementary_functions>(z));
+        const pack_type hfsq = mul(set(0.5), mul(f, f));
+        pack_type result = fma(s, add(hfsq, R), mul(e, set(coefficients::log_ln2_lo)));
+        result = fma(e, set(coefficients::log_ln2_hi), sub(f, sub(hfsq, result)));
+        result = select(equal(x, set(std::numeric_limits<value_type>::infinity())), x, result);
+        result = select(equal(x, set(0)), set(-std::numeric_limits<value_type>::infinity()), result);
+        result = select(less(x, set(0)), set(std::numeric_limits<value_type>::quiet_NaN()), result);
+        return select(equal(x, x), result, x);
+    }
+
+    // x = j*pi/2 + r with |r| <= pi/4, quadrant selects between the sine
+    // and cosine polynomial of r and the sign
+    static pack_type sincos(pack_type x, pack_type quadrant_offset) {
+        const pack_type j = round(mul(x, set(coefficients::two_over_pi)));
+        const pack_type r = coefficients::template reduce<elementary_functions>(x, j);
+        const pack_type z = mul(r, r);
+        const pack_type sin_r = fma(mul(r, z), coefficients::template sin<elementary_functions>(z), r);
+        const pack_type cos_r = fma(mul(z, z), coefficients::template cos<elementary_functions>(z), fnma(set(0.5), z, set(1)));
+        const pack_type q = add(j, quadrant_offset);
+        const pack_type half = floor(mul(q, set(0.5)));
+        const pack_type odd = sub(q, add(half, half));
+        const pack_type negative = sub(half, mul(set(2), floor(mul(half, set(0.5)))));
+        const pack_type result = select(less(set(0.5), odd), cos_r, sin_r);
+        return select(less(set(0.5), negative), mul(result, set(-1)), result);
+    }
+    static pack_type sin(pack_type x) { return sincos(x, set(0)); }
+    static pack_type cos(pack_type x) { return sincos(x, set(1)); }
+
+    static pack_type tanh(pack_type x) {
+        const pack_type a = bit_and(x, set_bits(~(bits_type(1) << (8*sizeof(value_type)-1))));
+        const pack_type z = mul(x, x);
+        const pack_type small = fma(mul(x, z), coefficients::template tanh<elementary_functions>(z), x);
+        pack_type large = sub(set(1), div(set(2), add(exp(add(a, a)), set(1))));
+        large = select(less(x, set(0)), mul(large, set(-1)), large);
+        return select(less(a, set(0.625)), small, large);
+    }
+
+    static pack_type pow(pack_type x, pack_type y) {
+        const pack_type result = exp(mul(y, log(x)));
+        const pack_type one = set(1);
+        return select(bit_or(equal(y, set(0)), equal(x, one)), one, result);
+    }
+
+    // Newton-Raphson steps roughly double the number of correct bits of
+    // the estimate. 0 and infinity turn into NaN on the way while their
+    // estimate is already exact, so those lanes keep the estimate.
+    static pack_type rsqrt(pack_type a, exact_precision) { return div(set(1), model::template unary<sqrt_tag>(a)); }
+    static pack_type rsqrt(pack_type a, fast_precision) { return model::rsqrt_estimate(a); }
+    template<int steps>
+    static pack_type rsqrt(pack_type a, refined_precision<steps>) {
+        const pack_type estimate = model::rsqrt_estimate(a);
+        const pack_type half = mul(a, set(0.5));
+        pack_type y = estimate;
+        for(int k = 0;k<steps;++k)
+            y = mul(y, fnma(mul(half, y), y, set(1.5)));
+        return select(equal(y, y), y, estimate);
+    }
+
+    static pack_type rcp(pack_type a, exact_precision) { return div(set(1), a); }
+    static pack_type rcp(pack_type a, fast_precision) { return model::rcp_estimate(a); }
+    template<int steps>
+    static pack_type rcp(pack_type a, refined_precision<steps>) {
+        const pack_type estimate = model::rcp_estimate(a);
+        pack_type y = estimate;
+        for(int k = 0;k<steps;++k)
+            y = fma(y, fnma(a, y, set(1)), y);
+        return select(equal(y, y), y, estimate);
+    }
+};
@@ -0,0 +1,394 @@
+
+// component_indices<0, ..., N-1> walks the components of a vector valued
+// expression
+template<size_t... Is>
+struct component_indices { };
+
+template<size_t N, size_t... Is>
+struct make_component_indices : make_component_indices<N-1, N-1, Is...> { };
+
+template<size_t... Is>
+struct make_component_indices<0, Is...> {
+    typedef component_indices<Is...> type;
+};
+
+template<typename... Ts>
+class components;
+
+// dimension<T> is the number of components of T, 0 for anything that is
+// not vector valued
+template<typename T>
+struct dimension {
+    static const size_t value = 0;
+};
+
+template<typename... Ts>
+struct dimension<components<Ts...>> {
+    static const size_t value = sizeof...(Ts);
+};
+
+// component<I>(x) is the I-th component of a vector valued expression.
+// Anything else is the same for every component.
+template<size_t I, typename T1>
+const T1& component(const T1 &x) { return x; }
+
+template<size_t I, typename... Ts>
+const typename std::tuple_element<I, std::tuple<Ts...>>::type& component(const components<Ts...> &x) { return std::get<I>(x.parts()); }
+
+// components is a vector valued expression made of one ordinary expression
+// per component, like the x, y and z of a position. Arithmetic applies to
+// every component, scalars and scalar expressions are used for all of them.
+// Assigning to components of views evaluates all components in a single loop
+// through a fuse node, so
+//
+//     pos += dt*vel;
+//
+// updates three fields in one pass instead of three.
+template<typename... Ts>
+class components {
+public:
+    typedef std::tuple<Ts...> parts_type;
+
+    explicit components(const Ts&... parts) : parts_(parts...) { }
+    components(const components&) = default;
+
+    const parts_type& parts() const { return parts_; }
+
+    components& operator=(const components &rhs) {
+        update<serial_policy>(rhs);
+        return *this;
+    }
+    template<typename T1>
+    components& operator=(const T1 &rhs) {
+        update<serial_policy>(rhs);
+        return *this;
+    }
+    template<typename T1>
+    components& operator+=(const T1 &rhs) {
+        update<serial_policy>(*this + rhs);
+        return *this;
+    }
+    template<typename T1>
+    components& operator-=(const T1 &rhs) {
+        update<serial_policy>(*this - rhs);
+        return *this;
+    }
+    template<typename T1>
+    components& operator*=(const T1 &rhs) {
+        update<serial_policy>(*this * rhs);
+        return *this;
+    }
+    template<typename T1>
+    components& operator/=(const T1 &rhs) {
+        update<serial_policy>(*this / rhs);
+        return *this;
+    }
+
+    template<typename policy, typename T1>
+    void assign(const T1 &rhs) {
+        update<policy>(rhs);
+    }
+    template<typename policy, typename T1>
+    void update(const T1 &rhs) {
+        static_assert(dimension<T1>::value == 0 || dimension<T1>::value == sizeof...(Ts), "components need the same dimension");
+        run<policy>(rhs, typename make_component_indices<sizeof...(Ts)>::type());
+    }
+private:
+    template<typename policy, typename T1, size_t... Is>
+    void run(const T1 &rhs, component_indices<Is...>) {
+        typedef typename std::remove_reference<typename std::tuple_element<0, parts_type>::type>::type first_type;
+        typedef typename first_type::value_type value_type;
+        policy::template execute<vector_instruction_set<value_type>, scalar_instruction_set<value_type>>(
+            fuse(storeu(std::get<Is>(parts_).data(), component<Is>(rhs))...), std::get<0>(parts_).size());
+    }
+
+    parts_type parts_;
+};
+
+// component_type is how make_components holds a part: arrays that can be
+// written become views, everything else is stored like in any expression
+template<typename T>
+struct component_type {
+    typedef typename store_type<typename std::decay<T>::type>::type type;
+};
+
+template<typename T, size_t N>
+struct component_type<arithmetic_array<T,N>&> {
+    typedef array_view<T> type;
+};
+
+template<typename T, size_t N>
+array_view<T> component_part(arithmetic_array<T,N> &x) { return array_view<T>(x.data(), x.size()); }
+
+template<typename T>
+const T& component_part(const T &x) { return x; }
+
+template<typename... Ts>
+components<typename component_type<Ts>::type...> make_components(Ts&&... parts) {
+    return components<typename component_type<Ts>::type...>(component_part(parts)...);
+}
+
+// components_map applies op to the matching components of a and b
+template<typename op, typename T1, typename T2, typename I>
+struct components_map;
+
+template<typename op, typename T1, typename T2, size_t... Is>
+struct components_map<op, T1, T2, component_indices<Is...>> {
+    typedef components<typename store_type<decltype(op::apply(component<Is>(std::declval<const T1&>()), component<Is>(std::declval<const T2&>())))>::type...> type;
+    static type apply(const T1 &a, const T2 &b) {
+        return type(op::apply(component<Is>(a), component<Is>(b))...);
+    }
+};
+
+#define ARITHMETIC_ARRAY_CREATE_COMPONENTS_BINARY(NAME,OP,TAG)\
+struct TAG {\
+    template<typename T1, typename T2>\
+    static auto apply(const T1 &a, const T2 &b) -> decltype(a OP b) { return a OP b; }\
+};\
+template<typename... T1, typename... T2>\
+typename components_map<TAG, components<T1...>, components<T2...>, typename make_component_indices<sizeof...(T1)>::type>::type \
+NAME(const components<T1...> &a, const components<T2...> &b) {\
+    static_assert(sizeof...(T1) == sizeof...(T2), "components need the same dimension");\
+    return components_map<TAG, components<T1...>, components<T2...>, typename make_component_indices<sizeof...(T1)>::type>::apply(a, b);\
+}\
+template<typename... T1, typename T2>\
+typename components_map<TAG, components<T1...>, T2, typename make_component_indices<sizeof...(T1)>::type>::type \
+NAME(const components<T1...> &a, const T2 &b) {\
+    return components_map<TAG, components<T1...>, T2, typename make_component_indices<sizeof...(T1)>::type>::apply(a, b);\
+}\
+template<typename T1, typename... T2>\
+typename components_map<TAG, T1, components<T2...>, typename make_component_indices<sizeof...(T2)>::type>::type \
+NAME(const T1 &a, const components<T2...> &b) {\
+    return components_map<TAG, T1, components<T2...>, typename make_component_indices<sizeof...(T2)>::type>::apply(a, b);\
+}
+
+ARITHMETIC_ARRAY_CREATE_COMPONENTS_BINARY(operator+, +, components_add)
+ARITHMETIC_ARRAY_CREATE_COMPONENTS_BINARY(operator-, -, components_sub)
+ARITHMETIC_ARRAY_CREATE_COMPONENTS_BINARY(operator*, *, components_mul)
+ARITHMETIC_ARRAY_CREATE_COMPONENTS_BINARY(operator/, /, components_div)
+
+#undef ARITHMETIC_ARRAY_CREATE_COMPONENTS_BINARY
+
+template<typename T, size_t>
+struct repeat_type {
+    typedef T type;
+};
+
+// field_components are the components of views of consecutive fields
+template<typename T, typename I>
+struct field_components;
+
+template<typename T, size_t... Is>
+struct field_components<T, component_indices<Is...>> {
+    typedef components<typename repeat_type<array_view<T>, Is>::type...> type;
+};
+
+// deinterleave nodes copy size records of F consecutive elements at records
+// into F arrays that start pitch elements apart, interleave nodes do the
+// opposite. end is the number of elements at records, nothing behind it is
+// read.
+template<size_t F>
+struct deinterleave_tag { };
+template<size_t F, typename T1>
+struct is_node<std::tuple<deinterleave_tag<F>, T1*, const T1*, size_t, size_t>> {
+    static const bool value = true;
+};
+template<size_t F, typename T1>
+std::tuple<deinterleave_tag<F>, T1*, const T1*, size_t, size_t>
+deinterleave(T1 *fields, size_t pitch, const T1 *records, size_t end) {
+    return std::tuple<deinterleave_tag<F>, T1*, const T1*, size_t, size_t>(deinterleave_tag<F>(), fields, records, pitch, end);
+}
+
+template<size_t F>
+struct interleave_tag { };
+template<size_t F, typename T1>
+struct is_node<std::tuple<interleave_tag<F>, T1*, const T1*, size_t>> {
+    static const bool value = true;
+};
+template<size_t F, typename T1>
+std::tuple<interleave_tag<F>, T1*, const T1*, size_t>
+interleave(T1 *records, const T1 *fields, size_t pitch) {
+    return std::tuple<interleave_tag<F>, T1*, const T1*, size_t>(interleave_tag<F>(), records, fields, pitch);
+}
+
+template<size_t F, typename T1>
+struct count<std::tuple<deinterleave_tag<F>, T1*, const T1*, size_t, size_t>> {
+    static const int loads = int(F);
+    static const int stores = int(F);
+    static const int operations = 0;
+    static const int immediates = 0;
+};
+template<size_t F, typename T1>
+struct count<std::tuple<interleave_tag<F>, T1*, const T1*, size_t>> : count<std::tuple<deinterleave_tag<F>, T1*, const T1*, size_t, size_t>> { };
+
+// a pack of records needs a register for every lane, so one is enough
+template<size_t F, typename T1>
+struct pinned_unroll<std::tuple<deinterleave_tag<F>, T1*, const T1*, size_t, size_t>> {
+    static const int value = 1;
+};
+template<size_t F, typename T1>
+struct pinned_unroll<std::tuple<interleave_tag<F>, T1*, const T1*, size_t>> {
+    static const int value = 1;
+};
+
+// record_lanes converts the pack_size records starting at index. Every
+// record is loaded as a row of pack_size elements starting at one of its
+// fields, which reaches into the following records, and transposing the rows
+// gives the packs of pack_size fields. Fields beyond F are not stored. The
+// other way around the rows are written in order, so what one row writes
+// past its record is overwritten by the next one, rows that would leave the
+// pack only write their record. Masked tails go element by element.
+template<typename model>
+struct record_lanes {
+    typedef typename model::value_type value_type;
+    typedef typename model::pack_type pack_type;
+    static const size_t lanes = model::pack_size;
+
+    template<size_t F>
+    ARRR_INLINE static void deinterleave(value_type *fields, const value_type *records, size_t pitch, size_t end, size_t index) {
+        const value_type *first = records+index*F;
+        for(size_t c = 0;c<F;c += lanes) {
+            const size_t width = F-c < lanes ? F-c : lanes;
+            pack_type rows[lanes];
+            for(size_t r = 0;r<lanes;++r) {
+                const value_type *row = first+r*F+c;
+                rows[r] = row+lanes <= records+end ? model::loadu(row, size_t(0)) : strided_lanes<model>::load(row, 1, width);
+            }
+            model::transpose(rows);
+            for(size_t k = 0;k<width;++k)
+                model::store(fields+(c+k)*pitch, index, rows[k]);
+        }
+    }
+    template<size_t F, typename I>
+    static void deinterleave(value_type *fields, const value_type *records, size_t pitch, size_t, const I &index) {
+        for(size_t i = index.index;i<index.index+model::lanes(index);++i)
+            for(size_t k = 0;k<F;++k)
+                fields[k*pitch+i] = records[i*F+k];
+    }
+
+    template<size_t F>
+    ARRR_INLINE static void interleave(value_type *records, const value_type *fields, size_t pitch, size_t index) {
+        static const size_t chunks = (F+lanes-1)/lanes;
+        pack_type rows[chunks][lanes];
+        for(size_t c = 0;c<chunks;++c) {
+            for(size_t k = 0;k<lanes;++k)
+                rows[c][k] = model::load(fields+std::min(c*lanes+k, F-1)*pitch, index);
+            model::transpose(rows[c]);
+        }
+        value_type *first = records+index*F;
+        for(size_t r = 0;r<lanes;++r) {
+            for(size_t c = 0;c<chunks;++c) {
+                value_type *row = first+r*F+c*lanes;
+                if(row+lanes <= first+lanes*F)
+                    model::storeu(row, size_t(0), rows[c][r]);
+                else
+                    strided_lanes<model>::store(row, 1, F-c*lanes < lanes ? F-c*lanes : lanes, rows[c][r]);
+            }
+        }
+    }
+    template<size_t F, typename I>
+    static void interleave(value_type *records, const value_type *fields, size_t pitch, const I &index) {
+        for(size_t i = index.index;i<index.index+model::lanes(index);++i)
+            for(size_t k = 0;k<F;++k)
+                records[i*F+k] = fields[k*pitch+i];
+    }
+};
+
+template<size_t F, typename T1, typename U, typename model>
+struct array_eval_t<std::tuple<deinterleave_tag<F>, T1*, const T1*, size_t, size_t>,U,model> {
+    typedef std::tuple<deinterleave_tag<F>, T1*, const T1*, size_t, size_t> node_type;
+    void prepare(const node_type &) { }
+    void load(const node_type &, const U &) { }
+    void store(const node_type &node, const U &userdata) {
+        record_lanes<model>::template deinterleave<F>(std::get<1>(node), std::get<2>(node), std::get<3>(node), std::get<4>(node), userdata);
+    }
+    void finish(const node_type &) { }
+    void operator()(const node_type &, const U &) { }
+};
+
+template<size_t F, typename T1, typename U, typename model>
+struct array_eval_t<std::tuple<interleave_tag<F>, T1*, const T1*, size_t>,U,model> {
+    typedef std::tuple<interleave_tag<F>, T1*, const T1*, size_t> node_type;
+    void prepare(const node_type &) { }
+    void load(const node_type &, const U &) { }
+    void store(const node_type &node, const U &userdata) {
+        record_lanes<model>::template interleave<F>(std::get<1>(node), std::get<2>(node), std::get<3>(node), userdata);
+    }
+    void finish(const node_type &) { }
+    void operator()(const node_type &, const U &) { }
+};
+
+// record_array stores size records of F fields of type T as F separate
+// arrays (structure of arrays). Every field starts aligned like the storage
+// of an arithmetic_array. field(k) is a view of one field and fields<B, N>()
+// the components of the fields B to B+N-1, so with x, y, z, vx, vy, vz, mass
+//
+//     auto pos = particles.fields<0, 3>();
+//     pos += dt*particles.fields<3, 3>();
+//
+// updates all three coordinates in one loop. load_records and store_records
+// convert from and to interleaved records (array of structures).
+template<typename T, size_t F>
+class record_array {
+public:
+    static_assert(F >= 1, "records need at least one field");
+
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef vector_instruction_set<T> vector_model;
+    typedef scalar_instruction_set<T> scalar_model;
+    static const size_t field_count = F;
+
+    explicit record_array(size_t size, T val = T())
+    : size_(size), pitch_(round_up(size)),
+      data_(static_cast<T*>(_mm_malloc(std::max(F*pitch_, size_t(1))*sizeof(T), vector_model::alignment)), &_mm_free)
+    {
+        std::fill(data_.get(), data_.get()+F*pitch_, val);
+    }
+
+    size_type size() const { return size_; }
+    pointer data(size_t k) { return data_.get()+k*pitch_; }
+    const_pointer data(size_t k) const { return data_.get()+k*pitch_; }
+    array_view<T> field(size_t k) { return array_view<T>(data(k), size_); }
+    array_view<const T> field(size_t k) const { return array_view<const T>(data(k), size_); }
+
+    template<size_t B, size_t N>
+    typename field_components<T, typename make_component_indices<N>::type>::type fields() {
+        static_assert(B+N <= F, "fields out of range");
+        return views<T, B>(typename make_component_indices<N>::type());
+    }
+    template<size_t B, size_t N>
+    typename field_components<const T, typename make_component_indices<N>::type>::type fields() const {
+        static_assert(B+N <= F, "fields out of range");
+        return views<const T, B>(typename make_component_indices<N>::type());
+    }
+
+    // load_records reads size records of F consecutive elements and
+    // store_records writes them, all fields in one pass
+    template<typename policy = serial_policy>
+    void load_records(const_pointer records) {
+        policy::template execute<vector_model, scalar_model>(deinterleave<F>(data_.get(), pitch_, records, size_*F), size_);
+    }
+    template<typename policy = serial_policy>
+    void store_records(pointer records) const {
+        policy::template execute<vector_model, scalar_model>(interleave<F>(records, static_cast<const_pointer>(data_.get()), pitch_), size_);
+    }
+private:
+    record_array(const record_array&) = delete;
+
+    static size_t round_up(size_t n) {
+        const size_t step = vector_model::alignment/sizeof(T) > 0 ? vector_model::alignment/sizeof(T) : 1;
+        return (n+step-1)/step*step;
+    }
+
+    template<typename V, size_t B, size_t... Is>
+    typename field_components<V, component_indices<Is...>>::type views(component_indices<Is...>) const {
+        return typename field_components<V, component_indices<Is...>>::type(array_view<V>(const_cast<pointer>(data(B+Is)), size_)...);
+    }
+
+    size_type size_;
+    size_type pitch_;
+    std::unique_ptr<value_type[],void(*)(void*)> data_;
+};
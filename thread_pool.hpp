@@ -0,0 +1,105 @@
+
+// thread_pool keeps a fixed set of worker threads alive between calls so
+// parallel_execute does not pay for thread creation. On linux worker k is
+// pinned to cpu k. run() executes job(k) for every k in [0, size()) with
+// the calling thread taking k = 0 and returns once all of them are done.
+// Jobs must not call run() on the same pool again.
+class thread_pool {
+public:
+    explicit thread_pool(size_t threads)
+    : generation_(0), pending_(0), stop_(false), job_(nullptr)
+    {
+        for(size_t k = 1;k<threads;++k)
+            workers_.emplace_back(&thread_pool::work, this, k);
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for(std::thread &worker : workers_)
+            worker.join();
+    }
+
+    size_t size() const { return workers_.size()+1; }
+
+    template<typename F>
+    void run(F job) {
+        std::function<void(size_t)> function(job);
+        std::lock_guard<std::mutex> serialize(run_mutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &function;
+            pending_ = workers_.size();
+            ++generation_;
+        }
+        wake_.notify_all();
+        function(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]{ return pending_ == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    void work(size_t index) {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index%CPU_SETSIZE, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for(;;) {
+            wake_.wait(lock, [&]{ return stop_ || generation_ != seen; });
+            if(stop_)
+                return;
+            seen = generation_;
+            const std::function<void(size_t)> *job = job_;
+            lock.unlock();
+            (*job)(index);
+            lock.lock();
+            if(--pending_ == 0)
+                done_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    size_t generation_;
+    size_t pending_;
+    bool stop_;
+    const std::function<void(size_t)> *job_;
+};
+
+// the default pool is created on first use with one thread per hardware
+// thread unless the ARRR_NUM_THREADS environment variable says otherwise.
+inline thread_pool& default_thread_pool() {
+    static thread_pool pool([]() -> size_t {
+        const char *env = std::getenv("ARRR_NUM_THREADS");
+        const size_t threads = env ? std::strtoul(env, nullptr, 10) : std::thread::hardware_concurrency();
+        return threads == 0 ? 1 : threads;
+    }());
+    return pool;
+}
+
+// expressions shorter than parallel_threshold() elements are executed on the
+// calling thread since waking the pool costs more than it saves.
+inline size_t& parallel_threshold() {
+    static size_t threshold = 1<<16;
+    return threshold;
+}
+
+// serializes the final combine step of reductions that run on several threads.
+inline std::mutex& reduction_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}